@@ -0,0 +1,125 @@
+//  Copyright 2022 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/*
+ * Arena (aka. region) allocator: O(1) pointer bumps in large chunks
+ * obtained from the underlying runtime, all released at once.
+ */
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <malloc.h>
+
+#include "third_party/nanolibc/c/libc_internals.h"
+
+#define NNLC_ARENA_DEFAULT_CHUNK_SIZE (64 * 1024)
+
+#define NNLC_ALIGNMENT_MASK (NNLC_MALLOC_ALIGNMENT - 1)
+
+/* Header of each chunk obtained from the runtime, data follows */
+struct arena_chunk {
+  struct arena_chunk *prev; /* chunk allocated before this one */
+  char *end;
+};
+
+struct nnlc_arena {
+  struct arena_chunk *chunk; /* most recent chunk, NULL if none */
+  char *next, *end;          /* free space left in 'chunk' */
+  size_t chunk_size;
+};
+
+static inline char *align_up(char *p) {
+  return (char *)(((uintptr_t)p + NNLC_ALIGNMENT_MASK) &
+                  ~(uintptr_t)NNLC_ALIGNMENT_MASK);
+}
+
+/* Make room for at least 'size' bytes in a new chunk. Return FALSE
+ * when out of memory. */
+static int arena_grow(struct nnlc_arena *arena, size_t size) {
+  size_t chunk_size = sizeof(struct arena_chunk) + NNLC_ALIGNMENT_MASK + size;
+  struct arena_chunk *chunk;
+
+  if (chunk_size < size) return 0; /* overflow */
+  if (chunk_size < arena->chunk_size) chunk_size = arena->chunk_size;
+
+  chunk = __nnlc_internal_data.sysdeps->malloc(chunk_size);
+  if (NULL == chunk) return 0;
+
+  chunk->prev = arena->chunk;
+  chunk->end = (char *)chunk + chunk_size;
+
+  /* The space left in the previous chunk is lost */
+  arena->chunk = chunk;
+  arena->next = align_up((char *)(chunk + 1));
+  arena->end = chunk->end;
+  return 1;
+}
+
+struct nnlc_arena *nnlc_arena_create(size_t chunk_size) {
+  struct nnlc_arena *arena =
+      __nnlc_internal_data.sysdeps->malloc(sizeof(*arena));
+  if (NULL == arena) return NULL;
+  /* malloc.c keeps tags in its low bits */
+  assert(((uintptr_t)arena & 0x7) == 0);
+
+  arena->chunk = NULL;
+  arena->next = arena->end = NULL;
+  arena->chunk_size = chunk_size ? chunk_size : NNLC_ARENA_DEFAULT_CHUNK_SIZE;
+  return arena;
+}
+
+void nnlc_arena_destroy(struct nnlc_arena *arena) {
+  const struct nnlc_arena_mark empty = {NULL, NULL};
+
+  if (NULL == arena) return;
+
+  nnlc_arena_rewind(arena, empty);
+  __nnlc_internal_data.sysdeps->free(arena);
+}
+
+void *nnlc_arena_alloc(struct nnlc_arena *arena, size_t size) {
+  char *p;
+
+  if (size > (size_t)-1 - NNLC_ALIGNMENT_MASK) return NULL; /* overflow */
+  size = (size + NNLC_ALIGNMENT_MASK) & ~(size_t)NNLC_ALIGNMENT_MASK;
+
+  if ((size_t)(arena->end - arena->next) < size && !arena_grow(arena, size))
+    return NULL;
+
+  p = arena->next;
+  arena->next += size;
+  return p;
+}
+
+struct nnlc_arena_mark nnlc_arena_get_mark(struct nnlc_arena *arena) {
+  struct nnlc_arena_mark mark;
+  mark.chunk = arena->chunk;
+  mark.next = arena->next;
+  return mark;
+}
+
+void nnlc_arena_rewind(struct nnlc_arena *arena, struct nnlc_arena_mark mark) {
+  /* release the chunks allocated after the mark */
+  while (arena->chunk != mark.chunk) {
+    struct arena_chunk *prev = arena->chunk->prev;
+    __nnlc_internal_data.sysdeps->free(arena->chunk);
+    arena->chunk = prev;
+  }
+
+  arena->next = mark.next;
+  arena->end = arena->chunk ? arena->chunk->end : NULL;
+}
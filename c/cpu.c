@@ -0,0 +1,74 @@
+//  Copyright 2022 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/*
+ * Detection of the CPU features nanolibc can take advantage of.
+ */
+
+#include <stdint.h>
+
+#include "third_party/nanolibc/c/libc_internals.h"
+
+#if defined(__x86_64__)
+
+static void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4]) {
+  __asm__ volatile("cpuid"
+                   : "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]),
+                     "=d"(regs[3])
+                   : "a"(leaf), "c"(subleaf));
+}
+
+static uint64_t xgetbv(uint32_t xcr) {
+  uint32_t lo, hi;
+  __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(xcr));
+  return ((uint64_t)hi << 32) | lo;
+}
+
+unsigned __nnlc_detect_cpu_features(void) {
+  unsigned features = 0;
+  uint32_t regs[4], max_leaf;
+  int os_avx = 0, os_avx512 = 0;
+
+  cpuid(0, 0, regs);
+  max_leaf = regs[0];
+
+  cpuid(1, 0, regs);
+  if (regs[2] & (1u << 20)) features |= NNLC_CPU_SSE42;
+  /* AVX registers are usable only if the OS (or firmware) enabled
+   * their state in XCR0: OSXSAVE tells XGETBV is available */
+  if ((regs[2] & (1u << 27)) && (regs[2] & (1u << 28))) {
+    const uint64_t xcr0 = xgetbv(0);
+    os_avx = (xcr0 & 0x6) == 0x6;        /* XMM, YMM */
+    os_avx512 = (xcr0 & 0xe6) == 0xe6;   /* and opmask, ZMM */
+  }
+
+  if (max_leaf >= 7) {
+    cpuid(7, 0, regs);
+    if (regs[1] & (1u << 9)) features |= NNLC_CPU_ERMS;
+    if (os_avx && (regs[1] & (1u << 5))) features |= NNLC_CPU_AVX2;
+    /* AVX512F and AVX512BW, the latter for byte operations */
+    if (os_avx512 && (features & NNLC_CPU_AVX2) &&
+        (regs[1] & (1u << 16)) && (regs[1] & (1u << 30)))
+      features |= NNLC_CPU_AVX512;
+  }
+
+  return features;
+}
+
+#else
+
+unsigned __nnlc_detect_cpu_features(void) { return 0; }
+
+#endif
@@ -0,0 +1,443 @@
+//  Copyright 2022 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Decimal digits of a double, for the printf engine (see format.c).
+ * Integer arithmetic only, no libm.
+ *
+ * The shortest digits that read back as the same double come from
+ * Grisu3 (Loitsch, "Printing Floating-Point Numbers Quickly and
+ * Accurately with Integers", PLDI 2010), which gives up on about 0.5%
+ * of the doubles. When it gives up, or when its output is not enough
+ * to round correctly, the exact decimal expansion of the double is
+ * computed with a bignum.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "third_party/nanolibc/c/libc_internals.h"
+
+#define DBL_FRAC_BITS 52
+#define DBL_FRAC_MASK ((UINT64_C(1) << DBL_FRAC_BITS) - 1)
+#define DBL_HIDDEN_BIT (UINT64_C(1) << DBL_FRAC_BITS)
+#define DBL_EXP_BIAS 1075 /* value is f * 2^(exponent - bias) */
+
+/*
+ * Grisu3
+ */
+
+/* f * 2^e */
+struct diy_fp {
+  uint64_t f;
+  int e;
+};
+
+/* 10^k = f * 2^e, k = -348 + 8 * i, f rounded to 64 bits */
+static const struct {
+  uint64_t f;
+  int16_t e;
+  int16_t k;
+} cached_powers[] = {
+    {0xfa8fd5a0081c0288ULL, -1220, -348},
+    {0xbaaee17fa23ebf76ULL, -1193, -340},
+    {0x8b16fb203055ac76ULL, -1166, -332},
+    {0xcf42894a5dce35eaULL, -1140, -324},
+    {0x9a6bb0aa55653b2dULL, -1113, -316},
+    {0xe61acf033d1a45dfULL, -1087, -308},
+    {0xab70fe17c79ac6caULL, -1060, -300},
+    {0xff77b1fcbebcdc4fULL, -1034, -292},
+    {0xbe5691ef416bd60cULL, -1007, -284},
+    {0x8dd01fad907ffc3cULL, -980, -276},
+    {0xd3515c2831559a83ULL, -954, -268},
+    {0x9d71ac8fada6c9b5ULL, -927, -260},
+    {0xea9c227723ee8bcbULL, -901, -252},
+    {0xaecc49914078536dULL, -874, -244},
+    {0x823c12795db6ce57ULL, -847, -236},
+    {0xc21094364dfb5637ULL, -821, -228},
+    {0x9096ea6f3848984fULL, -794, -220},
+    {0xd77485cb25823ac7ULL, -768, -212},
+    {0xa086cfcd97bf97f4ULL, -741, -204},
+    {0xef340a98172aace5ULL, -715, -196},
+    {0xb23867fb2a35b28eULL, -688, -188},
+    {0x84c8d4dfd2c63f3bULL, -661, -180},
+    {0xc5dd44271ad3cdbaULL, -635, -172},
+    {0x936b9fcebb25c996ULL, -608, -164},
+    {0xdbac6c247d62a584ULL, -582, -156},
+    {0xa3ab66580d5fdaf6ULL, -555, -148},
+    {0xf3e2f893dec3f126ULL, -529, -140},
+    {0xb5b5ada8aaff80b8ULL, -502, -132},
+    {0x87625f056c7c4a8bULL, -475, -124},
+    {0xc9bcff6034c13053ULL, -449, -116},
+    {0x964e858c91ba2655ULL, -422, -108},
+    {0xdff9772470297ebdULL, -396, -100},
+    {0xa6dfbd9fb8e5b88fULL, -369, -92},
+    {0xf8a95fcf88747d94ULL, -343, -84},
+    {0xb94470938fa89bcfULL, -316, -76},
+    {0x8a08f0f8bf0f156bULL, -289, -68},
+    {0xcdb02555653131b6ULL, -263, -60},
+    {0x993fe2c6d07b7facULL, -236, -52},
+    {0xe45c10c42a2b3b06ULL, -210, -44},
+    {0xaa242499697392d3ULL, -183, -36},
+    {0xfd87b5f28300ca0eULL, -157, -28},
+    {0xbce5086492111aebULL, -130, -20},
+    {0x8cbccc096f5088ccULL, -103, -12},
+    {0xd1b71758e219652cULL, -77, -4},
+    {0x9c40000000000000ULL, -50, 4},
+    {0xe8d4a51000000000ULL, -24, 12},
+    {0xad78ebc5ac620000ULL, 3, 20},
+    {0x813f3978f8940984ULL, 30, 28},
+    {0xc097ce7bc90715b3ULL, 56, 36},
+    {0x8f7e32ce7bea5c70ULL, 83, 44},
+    {0xd5d238a4abe98068ULL, 109, 52},
+    {0x9f4f2726179a2245ULL, 136, 60},
+    {0xed63a231d4c4fb27ULL, 162, 68},
+    {0xb0de65388cc8ada8ULL, 189, 76},
+    {0x83c7088e1aab65dbULL, 216, 84},
+    {0xc45d1df942711d9aULL, 242, 92},
+    {0x924d692ca61be758ULL, 269, 100},
+    {0xda01ee641a708deaULL, 295, 108},
+    {0xa26da3999aef774aULL, 322, 116},
+    {0xf209787bb47d6b85ULL, 348, 124},
+    {0xb454e4a179dd1877ULL, 375, 132},
+    {0x865b86925b9bc5c2ULL, 402, 140},
+    {0xc83553c5c8965d3dULL, 428, 148},
+    {0x952ab45cfa97a0b3ULL, 455, 156},
+    {0xde469fbd99a05fe3ULL, 481, 164},
+    {0xa59bc234db398c25ULL, 508, 172},
+    {0xf6c69a72a3989f5cULL, 534, 180},
+    {0xb7dcbf5354e9beceULL, 561, 188},
+    {0x88fcf317f22241e2ULL, 588, 196},
+    {0xcc20ce9bd35c78a5ULL, 614, 204},
+    {0x98165af37b2153dfULL, 641, 212},
+    {0xe2a0b5dc971f303aULL, 667, 220},
+    {0xa8d9d1535ce3b396ULL, 694, 228},
+    {0xfb9b7cd9a4a7443cULL, 720, 236},
+    {0xbb764c4ca7a44410ULL, 747, 244},
+    {0x8bab8eefb6409c1aULL, 774, 252},
+    {0xd01fef10a657842cULL, 800, 260},
+    {0x9b10a4e5e9913129ULL, 827, 268},
+    {0xe7109bfba19c0c9dULL, 853, 276},
+    {0xac2820d9623bf429ULL, 880, 284},
+    {0x80444b5e7aa7cf85ULL, 907, 292},
+    {0xbf21e44003acdd2dULL, 933, 300},
+    {0x8e679c2f5e44ff8fULL, 960, 308},
+    {0xd433179d9c8cb841ULL, 986, 316},
+    {0x9e19db92b4e31ba9ULL, 1013, 324},
+    {0xeb96bf6ebadf77d9ULL, 1039, 332},
+    {0xaf87023b9bf0ee6bULL, 1066, 340},
+};
+
+#define CACHED_POWERS_OFFSET 348 /* -k of cached_powers[0] */
+#define CACHED_POWERS_STEP 8
+
+/* Wanted range of the binary exponent of the scaled value */
+#define GRISU_MIN_EXP (-60)
+#define GRISU_MAX_EXP (-32)
+
+static const uint32_t pow10_u32[] = {
+    1,      10,      100,      1000,      10000,
+    100000, 1000000, 10000000, 100000000, 1000000000};
+
+static struct diy_fp diy_mul(struct diy_fp x, struct diy_fp y) {
+  const uint64_t m32 = 0xffffffffu;
+  const uint64_t a = x.f >> 32, b = x.f & m32;
+  const uint64_t c = y.f >> 32, d = y.f & m32;
+  const uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+  uint64_t tmp = (bd >> 32) + (ad & m32) + (bc & m32);
+  struct diy_fp r;
+
+  tmp += 1u << 31; /* round */
+  r.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+  r.e = x.e + y.e + 64;
+  return r;
+}
+
+static struct diy_fp diy_normalize(struct diy_fp x) {
+  const int shift = __builtin_clzll(x.f);
+  x.f <<= shift;
+  x.e -= shift;
+  return x;
+}
+
+/* Cached 10^k with GRISU_MIN_EXP <= e + 64 + w_e <= GRISU_MAX_EXP */
+static struct diy_fp cached_power(int w_e, int *k) {
+  const int min_exp = GRISU_MIN_EXP - (w_e + 64);
+  /* ceil((min_exp + 63) * log10(2)), 78913 / 2^18 is log10(2) close
+   * enough for |n| < 1650 */
+  const int n = min_exp + 63;
+  const int dk = ((n * 78913) >> 18) + (n != 0);
+  const int i = (CACHED_POWERS_OFFSET + dk - 1) / CACHED_POWERS_STEP + 1;
+  struct diy_fp p;
+
+  p.f = cached_powers[i].f;
+  p.e = cached_powers[i].e;
+  *k = cached_powers[i].k;
+  return p;
+}
+
+/* Move the last digit of buf towards w while it stays in the safe
+ * interval. Returns 0 if the digits may not be the closest ones */
+static int round_weed(char *buf, int len, uint64_t dist_too_high_w,
+                      uint64_t unsafe_interval, uint64_t rest,
+                      uint64_t ten_kappa, uint64_t unit) {
+  const uint64_t small_dist = dist_too_high_w - unit;
+  const uint64_t big_dist = dist_too_high_w + unit;
+
+  while (rest < small_dist && unsafe_interval - rest >= ten_kappa &&
+         (rest + ten_kappa < small_dist ||
+          small_dist - rest >= rest + ten_kappa - small_dist)) {
+    buf[len - 1]--;
+    rest += ten_kappa;
+  }
+
+  if (rest < big_dist && unsafe_interval - rest >= ten_kappa &&
+      (rest + ten_kappa < big_dist ||
+       big_dist - rest > rest + ten_kappa - big_dist))
+    return 0;
+
+  return 2 * unit <= rest && rest <= unsafe_interval - 4 * unit;
+}
+
+/* Shortest digits between low and high, closest to w. Returns 0 if
+ * Grisu3 can't tell */
+static int digit_gen(struct diy_fp low, struct diy_fp w, struct diy_fp high,
+                     char *buf, int *len, int *kappa) {
+  uint64_t unit = 1;
+  const uint64_t too_low = low.f - unit;
+  const uint64_t too_high = high.f + unit;
+  uint64_t unsafe_interval = too_high - too_low;
+  const int shift = -w.e;
+  const uint64_t one = UINT64_C(1) << shift;
+  uint32_t integrals = too_high >> shift;
+  uint64_t fractionals = too_high & (one - 1);
+  uint32_t divisor;
+
+  *kappa = 10;
+  while (*kappa > 0 && pow10_u32[*kappa - 1] > integrals) --*kappa;
+  divisor = (*kappa > 0) ? pow10_u32[*kappa - 1] : 0;
+
+  *len = 0;
+  while (*kappa > 0) {
+    uint64_t rest;
+    buf[(*len)++] = '0' + integrals / divisor;
+    integrals %= divisor;
+    --*kappa;
+    rest = ((uint64_t)integrals << shift) + fractionals;
+    if (rest < unsafe_interval)
+      return round_weed(buf, *len, too_high - w.f, unsafe_interval, rest,
+                        (uint64_t)divisor << shift, unit);
+    divisor /= 10;
+  }
+
+  for (;;) {
+    fractionals *= 10;
+    unit *= 10;
+    unsafe_interval *= 10;
+    buf[(*len)++] = '0' + (fractionals >> shift);
+    fractionals &= one - 1;
+    --*kappa;
+    if (fractionals < unsafe_interval)
+      return round_weed(buf, *len, (too_high - w.f) * unit, unsafe_interval,
+                        fractionals, one, unit);
+  }
+}
+
+/* Shortest digits of f * 2^e (f != 0) that read back as the same
+ * double. Returns 0 if Grisu3 can't tell */
+static int grisu3(uint64_t f, int e, int lower_closer,
+                  struct nnlc_decimal *d) {
+  struct diy_fp w, plus, minus, ten_mk;
+  int mk, kappa, len;
+
+  w.f = f;
+  w.e = e;
+  w = diy_normalize(w);
+
+  /* boundaries: halfway to the neighbours */
+  plus.f = (f << 1) + 1;
+  plus.e = e - 1;
+  plus = diy_normalize(plus);
+  if (lower_closer) {
+    minus.f = (f << 2) - 1;
+    minus.e = e - 2;
+  } else {
+    minus.f = (f << 1) - 1;
+    minus.e = e - 1;
+  }
+  minus.f <<= minus.e - plus.e;
+  minus.e = plus.e;
+
+  ten_mk = cached_power(w.e, &mk);
+  if (!digit_gen(diy_mul(minus, ten_mk), diy_mul(w, ten_mk),
+                 diy_mul(plus, ten_mk), d->digits, &len, &kappa))
+    return 0;
+
+  d->n = len;
+  d->e = len - 1 + kappa - mk;
+  return 1;
+}
+
+/*
+ * Exact decimal expansion, for the doubles Grisu3 can't do
+ */
+
+/* Words of m * 5^1074, m < 2^53 */
+#define BIG_WORDS 84
+
+struct big {
+  uint32_t w[BIG_WORDS]; /* little endian */
+  int len;
+};
+
+static void big_mul(struct big *b, uint32_t k) {
+  uint64_t carry = 0;
+  int i;
+
+  for (i = 0; i < b->len; ++i) {
+    carry += (uint64_t)b->w[i] * k;
+    b->w[i] = (uint32_t)carry;
+    carry >>= 32;
+  }
+  if (carry) b->w[b->len++] = carry;
+}
+
+/* b /= 10^9, returns the remainder */
+static uint32_t big_div_1e9(struct big *b) {
+  uint64_t rem = 0;
+  int i;
+
+  for (i = b->len - 1; i >= 0; --i) {
+    rem = (rem << 32) | b->w[i];
+    b->w[i] = rem / 1000000000;
+    rem %= 1000000000;
+  }
+  while (b->len > 0 && b->w[b->len - 1] == 0) --b->len;
+  return rem;
+}
+
+/* All the digits of f * 2^e (f != 0) */
+static void exact(uint64_t f, int e, struct nnlc_decimal *d) {
+  uint32_t chunks[(NNLC_DECIMAL_DIGITS + 8) / 9];
+  struct big b;
+  int pow10 = 0, nchunks = 0, i;
+  char *p = d->digits;
+
+  while (!(f & 1)) {
+    f >>= 1;
+    ++e;
+  }
+
+  memset(&b, 0, sizeof(b));
+  if (e >= 0) {
+    /* f * 2^e, an integer */
+    const int word = e / 32, bit = e % 32;
+    b.w[word] = (uint32_t)(f << bit);
+    b.w[word + 1] = (uint32_t)(f >> (32 - bit));
+    b.w[word + 2] = bit ? (uint32_t)(f >> (64 - bit)) : 0;
+    b.len = word + 3;
+  } else {
+    /* f * 2^e = f * 5^-e * 10^e */
+    b.w[0] = (uint32_t)f;
+    b.w[1] = (uint32_t)(f >> 32);
+    b.len = 2;
+    for (pow10 = e; e <= -13; e += 13) big_mul(&b, 1220703125); /* 5^13 */
+    for (; e < 0; ++e) big_mul(&b, 5);
+  }
+  while (b.len > 0 && b.w[b.len - 1] == 0) --b.len;
+
+  while (b.len > 0) chunks[nchunks++] = big_div_1e9(&b);
+
+  /* the first chunk without its leading zeros */
+  for (i = 9; i > 0 && chunks[nchunks - 1] < pow10_u32[i - 1]; --i) {
+  }
+  for (; i > 0; --i) *p++ = '0' + chunks[nchunks - 1] / pow10_u32[i - 1] % 10;
+  for (--nchunks; nchunks > 0; --nchunks)
+    for (i = 9; i > 0; --i)
+      *p++ = '0' + chunks[nchunks - 1] / pow10_u32[i - 1] % 10;
+
+  d->n = p - d->digits;
+  d->e = d->n - 1 + pow10;
+  while (d->digits[d->n - 1] == '0') --d->n;
+}
+
+/* Keep the first keep digits of d, rounded to nearest. Ties go to
+ * the even digit if d is exact, or return 0 otherwise: the digits
+ * that follow d are unknown */
+static int round_digits(struct nnlc_decimal *d, int keep, int is_exact) {
+  int up;
+
+  if (keep >= d->n) return 1;
+
+  if (keep < 0) {
+    up = 0;
+  } else if (d->digits[keep] != '5' || d->n > keep + 1) {
+    up = d->digits[keep] >= '5';
+  } else {
+    if (!is_exact) return 0;
+    up = keep > 0 && ((d->digits[keep - 1] - '0') & 1);
+  }
+
+  d->n = (keep > 0) ? keep : 0;
+  if (up) {
+    while (d->n > 0 && d->digits[d->n - 1] == '9') --d->n;
+    if (d->n == 0) {
+      d->digits[d->n++] = '1';
+      ++d->e;
+    } else {
+      d->digits[d->n - 1]++;
+    }
+  }
+  while (d->n > 0 && d->digits[d->n - 1] == '0') --d->n;
+  return 1;
+}
+
+void __nnlc_dtoa(double v, int mode, int prec, struct nnlc_decimal *d) {
+  uint64_t bits, f;
+  int biased, e, keep;
+
+  /* all the digits past the 1074th decimal are 0s */
+  if (prec > 1100) prec = 1100;
+
+  memcpy(&bits, &v, sizeof(bits));
+  biased = (bits >> DBL_FRAC_BITS) & 0x7ff;
+  f = bits & DBL_FRAC_MASK;
+  if (biased == 0 && f == 0) {
+    d->n = 0;
+    d->e = 0;
+    return;
+  }
+  if (biased != 0) f |= DBL_HIDDEN_BIT;
+  e = (biased ? biased : 1) - DBL_EXP_BIAS;
+
+  /* Shortest digits s are within half an ulp of v. Rounding s at
+   * keep < length(s) digits gives the same as rounding v, unless s
+   * ends on a tie: there is no rounding boundary between v and s,
+   * as it would be shorter than s (or as long, and closer to v).
+   * For keep > length(s), s is the closest keep-digits number to v
+   * as long as these are more than an ulp apart: keep <= 15, and
+   * only for normal numbers */
+  if (biased != 0 && grisu3(f, e, f == DBL_HIDDEN_BIT && biased > 1, d)) {
+    keep = (mode == NNLC_DTOA_FIXED) ? d->e + 1 + prec : prec;
+    if ((keep <= d->n || keep <= 15) && round_digits(d, keep, 0)) {
+      if (d->n == 0) d->e = 0;
+      return;
+    }
+  }
+
+  exact(f, e, d);
+  keep = (mode == NNLC_DTOA_FIXED) ? d->e + 1 + prec : prec;
+  round_digits(d, keep, 1);
+  if (d->n == 0) d->e = 0;
+}
@@ -0,0 +1,886 @@
+//  Copyright 2022 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * printf engine behind the printf family (see stdio.c). The output
+ * goes to the caller's emit() callback as spans: runs of the format
+ * between conversions, whole converted fields and their padding.
+ * The digits of floating point numbers come from dtoa.c.
+ */
+
+#include <limits.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "third_party/nanolibc/c/libc_internals.h"
+
+/* Most arguments a format with %n$ conversions may refer to */
+#define FORMAT_ARGMAX 32
+
+/* Flags of a conversion */
+#define FLAG_LEFT 0x01  /* '-' */
+#define FLAG_PLUS 0x02  /* '+' */
+#define FLAG_SPACE 0x04 /* ' ' */
+#define FLAG_ALT 0x08   /* '#' */
+#define FLAG_ZERO 0x10  /* '0' */
+
+/* Length modifiers */
+enum length {
+  LEN_NONE,
+  LEN_HH,
+  LEN_H,
+  LEN_L,
+  LEN_LL,
+  LEN_Z,
+  LEN_J,
+  LEN_T,
+  LEN_BIG_L /* long double */
+};
+
+/* How an argument is passed, ie. what va_arg() needs */
+enum arg_type {
+  ARG_NONE,
+  ARG_INT,
+  ARG_LONG,
+  ARG_LLONG,
+  ARG_SIZE,
+  ARG_INTMAX,
+  ARG_PTRDIFF,
+  ARG_PTR,
+  ARG_DOUBLE,
+  ARG_LDOUBLE
+};
+
+union arg {
+  int i;
+  long l;
+  long long ll;
+  size_t z;
+  intmax_t j;
+  ptrdiff_t t;
+  void *p;
+  double d;
+};
+
+/* A parsed conversion specification */
+struct conv {
+  int argpos;    /* n of %n$, 0 for the next argument */
+  int flags;     /* FLAG_* */
+  int width;     /* -1 if none */
+  int width_arg; /* '*': -1 for the next argument, n for '*n$', or 0 */
+  int prec;      /* -1 if none */
+  int prec_arg;  /* same as width_arg */
+  enum length len;
+  char type;     /* conversion character */
+};
+
+/* Where the arguments come from: the va_list, or pos[] when the
+ * format uses %n$ */
+struct args {
+  va_list ap;
+  union arg *pos;
+};
+
+struct out {
+  void *ctx;
+  nnlc_emit_t emit;
+  size_t total;
+};
+
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static void out(struct out *o, const char *s, size_t n) {
+  if (n == 0) return;
+  o->emit(o->ctx, s, n);
+  o->total += n;
+}
+
+static void pad(struct out *o, char c, size_t n) {
+  static const char spaces[] = "                                ";
+  static const char zeros[] = "00000000000000000000000000000000";
+  const char *run = (c == '0') ? zeros : spaces;
+
+  while (n > 0) {
+    const size_t k = (n < sizeof(spaces) - 1) ? n : sizeof(spaces) - 1;
+    out(o, run, k);
+    n -= k;
+  }
+}
+
+/* A field of n bytes at s, padded to the width of c */
+static void field(struct out *o, const struct conv *c, const char *s,
+                  size_t n) {
+  const size_t padding = ((size_t)c->width > n) ? c->width - n : 0;
+
+  if (!(c->flags & FLAG_LEFT)) pad(o, ' ', padding);
+  out(o, s, n);
+  if (c->flags & FLAG_LEFT) pad(o, ' ', padding);
+}
+
+/* Digits of v, stored backwards from end. Return the first digit */
+static char *dec_digits(uintmax_t v, char *end) {
+  while (v >= 100) {
+    const unsigned r = v % 100;
+    v /= 100;
+    end -= 2;
+    memcpy(end, &digit_pairs[2 * r], 2);
+  }
+  if (v >= 10) {
+    end -= 2;
+    memcpy(end, &digit_pairs[2 * v], 2);
+  } else {
+    *--end = '0' + v;
+  }
+  return end;
+}
+
+static char *hex_digits(uintmax_t v, char *end, int upper) {
+  const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+  do {
+    *--end = digits[v & 0xf];
+    v >>= 4;
+  } while (v);
+  return end;
+}
+
+static char *oct_digits(uintmax_t v, char *end) {
+  do {
+    *--end = '0' + (v & 7);
+    v >>= 3;
+  } while (v);
+  return end;
+}
+
+/* Integer conversions (d i u o x X p): [sign or 0x][zeros][digits] */
+static void format_int(struct out *o, const struct conv *c, uintmax_t v,
+                       int neg) {
+  char buf[3 * sizeof(uintmax_t)]; /* 22 octal digits at most */
+  char *const end = buf + sizeof(buf);
+  char *digits;
+  const char *prefix = "";
+  size_t ndigits, nprefix, zeros = 0, len;
+  const int prec = c->prec;
+
+  switch (c->type) {
+    case 'o':
+      digits = oct_digits(v, end);
+      break;
+    case 'x':
+    case 'X':
+    case 'p':
+      digits = hex_digits(v, end, c->type == 'X');
+      if ((c->flags & FLAG_ALT) && v != 0)
+        prefix = (c->type == 'X') ? "0X" : "0x";
+      break;
+    default:
+      digits = dec_digits(v, end);
+      if (neg)
+        prefix = "-";
+      else if (c->type != 'u' && (c->flags & FLAG_PLUS))
+        prefix = "+";
+      else if (c->type != 'u' && (c->flags & FLAG_SPACE))
+        prefix = " ";
+      break;
+  }
+
+  /* "%.0d" of 0 has no digits */
+  if (prec == 0 && v == 0) digits = end;
+  ndigits = end - digits;
+
+  nprefix = strlen(prefix);
+  if (prec > (int)ndigits) {
+    zeros = prec - ndigits;
+  } else if (prec < 0 && (c->flags & (FLAG_ZERO | FLAG_LEFT)) == FLAG_ZERO &&
+             (size_t)c->width > nprefix + ndigits) {
+    zeros = c->width - nprefix - ndigits;
+  }
+
+  /* '#' makes the first octal digit a 0 */
+  if (c->type == 'o' && (c->flags & FLAG_ALT) && zeros == 0 &&
+      (ndigits == 0 || *digits != '0'))
+    zeros = 1;
+
+  len = nprefix + zeros + ndigits;
+  if (!(c->flags & FLAG_LEFT) && (size_t)c->width > len)
+    pad(o, ' ', c->width - len);
+  out(o, prefix, nprefix);
+  pad(o, '0', zeros);
+  out(o, digits, ndigits);
+  if ((c->flags & FLAG_LEFT) && (size_t)c->width > len)
+    pad(o, ' ', c->width - len);
+}
+
+/* Digits from..from+count-1 of d, 0 outside of d->digits */
+static void dec_out(struct out *o, const struct nnlc_decimal *d, int from,
+                    int count) {
+  int k;
+
+  if (from < 0 && count > 0) {
+    k = (-from < count) ? -from : count;
+    pad(o, '0', k);
+    from += k;
+    count -= k;
+  }
+  if (from < d->n && count > 0) {
+    k = (d->n - from < count) ? d->n - from : count;
+    out(o, d->digits + from, k);
+    count -= k;
+  }
+  if (count > 0) pad(o, '0', count);
+}
+
+/* "e+05" for %e, "p-1022" for %a. Returns the length */
+static size_t exp_str(char *buf, char e, int exp, int min_digits) {
+  char digits[8];
+  char *const end = digits + sizeof(digits);
+  char *first = dec_digits((exp < 0) ? -exp : exp, end);
+  size_t n = 0;
+
+  buf[n++] = e;
+  buf[n++] = (exp < 0) ? '-' : '+';
+  if (min_digits == 2 && end - first < 2) buf[n++] = '0';
+  memcpy(buf + n, first, end - first);
+  return n + (end - first);
+}
+
+/* Hex digits of %a, in buf (the leading digit, '.', the others).
+ * Returns their length, *exp is the binary exponent */
+static size_t hex_float(char *buf, uint64_t bits, const struct conv *c,
+                        int *exp) {
+  const char *xdigits =
+      (c->type == 'A') ? "0123456789ABCDEF" : "0123456789abcdef";
+  const int biased = (bits >> 52) & 0x7ff;
+  uint64_t mant = bits & ((UINT64_C(1) << 52) - 1);
+  int lead = (biased != 0), ndigits = 13, i;
+  size_t n = 0;
+
+  *exp = (biased == 0 && mant == 0) ? 0 : (biased ? biased : 1) - 1023;
+
+  if (c->prec >= 0 && c->prec < 13) {
+    /* round to nearest, ties to even */
+    const int shift = 4 * (13 - c->prec);
+    const uint64_t rest = mant & ((UINT64_C(1) << shift) - 1);
+    const uint64_t half = UINT64_C(1) << (shift - 1);
+    const int odd = c->prec ? (mant >> shift) & 1 : lead & 1;
+
+    mant >>= shift;
+    if (rest > half || (rest == half && odd)) {
+      ++mant;
+      if (mant >> (4 * c->prec)) {
+        ++lead; /* 0x1.f8p+0 is 0x2.0p+0 at %.1a */
+        mant = 0;
+      }
+    }
+    ndigits = c->prec;
+  } else if (c->prec < 0) {
+    for (; ndigits > 0 && !(mant & 0xf); --ndigits) mant >>= 4;
+  }
+
+  buf[n++] = '0' + lead;
+  if (ndigits > 0 || (c->flags & FLAG_ALT)) buf[n++] = '.';
+  for (i = ndigits - 1; i >= 0; --i)
+    buf[n++] = xdigits[(mant >> (4 * i)) & 0xf];
+  return n;
+}
+
+/* Floating point conversions (f F e E g G a A):
+ * [sign or 0x][zeros][digits] */
+static void format_float(struct out *o, const struct conv *c, double v) {
+  const int upper = (c->type >= 'A' && c->type <= 'Z');
+  const int alt = (c->flags & FLAG_ALT) != 0;
+  struct nnlc_decimal d;
+  uint64_t bits;
+  char prefix[4], expbuf[8], hexbuf[16];
+  size_t nprefix = 0, nexp = 0, nhex = 0, body = 0, zeros = 0, len;
+  int prec = c->prec, style, exp;
+
+  memcpy(&bits, &v, sizeof(bits));
+  if (bits >> 63)
+    prefix[nprefix++] = '-';
+  else if (c->flags & FLAG_PLUS)
+    prefix[nprefix++] = '+';
+  else if (c->flags & FLAG_SPACE)
+    prefix[nprefix++] = ' ';
+
+  if (((bits >> 52) & 0x7ff) == 0x7ff) {
+    const int nan = (bits & ((UINT64_C(1) << 52) - 1)) != 0;
+    const char *s = nan ? (upper ? "NAN" : "nan") : (upper ? "INF" : "inf");
+    len = nprefix + 3;
+    if (!(c->flags & FLAG_LEFT) && (size_t)c->width > len)
+      pad(o, ' ', c->width - len);
+    out(o, prefix, nprefix);
+    out(o, s, 3);
+    if ((c->flags & FLAG_LEFT) && (size_t)c->width > len)
+      pad(o, ' ', c->width - len);
+    return;
+  }
+
+  style = c->type | 0x20; /* 'f', 'e', 'g' or 'a' */
+  switch (style) {
+    case 'a':
+      prefix[nprefix++] = '0';
+      prefix[nprefix++] = upper ? 'X' : 'x';
+      nhex = hex_float(hexbuf, bits, c, &exp);
+      nexp = exp_str(expbuf, upper ? 'P' : 'p', exp, 1);
+      if (prec < 0) prec = 0;
+      prec = (prec > 13) ? prec - 13 : 0; /* zeros after the digits */
+      body = nhex + prec + nexp;
+      break;
+
+    case 'g': {
+      const int p = (prec < 0) ? 6 : (prec == 0) ? 1 : prec;
+      __nnlc_dtoa(v, NNLC_DTOA_SIG, p, &d);
+      /* %e unless -4 <= exponent < p, no trailing zeros without '#' */
+      if (d.e < -4 || d.e >= p) {
+        style = 'e';
+        prec = p - 1;
+        if (!alt && prec > d.n - 1) prec = (d.n > 1) ? d.n - 1 : 0;
+      } else {
+        style = 'f';
+        prec = p - 1 - d.e;
+        if (!alt && prec > d.n - 1 - d.e)
+          prec = (d.n - 1 - d.e > 0) ? d.n - 1 - d.e : 0;
+      }
+      break;
+    }
+
+    case 'e':
+      if (prec < 0) prec = 6;
+      __nnlc_dtoa(v, NNLC_DTOA_SIG, prec + 1, &d);
+      break;
+
+    default:
+      if (prec < 0) prec = 6;
+      __nnlc_dtoa(v, NNLC_DTOA_FIXED, prec, &d);
+      break;
+  }
+
+  if (style == 'e') {
+    nexp = exp_str(expbuf, upper ? 'E' : 'e', d.e, 2);
+    body = 1 + (prec > 0 || alt) + prec + nexp;
+  } else if (style == 'f') {
+    body = ((d.e >= 0) ? d.e + 1 : 1) + (prec > 0 || alt) + prec;
+  }
+
+  if ((c->flags & (FLAG_ZERO | FLAG_LEFT)) == FLAG_ZERO &&
+      (size_t)c->width > nprefix + body)
+    zeros = c->width - nprefix - body;
+
+  len = nprefix + zeros + body;
+  if (!(c->flags & FLAG_LEFT) && (size_t)c->width > len)
+    pad(o, ' ', c->width - len);
+  out(o, prefix, nprefix);
+  pad(o, '0', zeros);
+
+  switch (style) {
+    case 'a':
+      out(o, hexbuf, nhex);
+      pad(o, '0', prec);
+      break;
+    case 'e':
+      dec_out(o, &d, 0, 1);
+      if (prec > 0 || alt) out(o, ".", 1);
+      dec_out(o, &d, 1, prec);
+      break;
+    default:
+      if (d.e >= 0)
+        dec_out(o, &d, 0, d.e + 1);
+      else
+        out(o, "0", 1);
+      if (prec > 0 || alt) out(o, ".", 1);
+      dec_out(o, &d, d.e + 1, prec);
+      break;
+  }
+  out(o, expbuf, nexp);
+
+  if ((c->flags & FLAG_LEFT) && (size_t)c->width > len)
+    pad(o, ' ', c->width - len);
+}
+
+/* Argument type of a conversion */
+static enum arg_type conv_arg_type(const struct conv *c) {
+  switch (c->type) {
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+      switch (c->len) {
+        case LEN_L:
+          return ARG_LONG;
+        case LEN_LL:
+          return ARG_LLONG;
+        case LEN_Z:
+          return ARG_SIZE;
+        case LEN_J:
+          return ARG_INTMAX;
+        case LEN_T:
+          return ARG_PTRDIFF;
+        default:
+          return ARG_INT; /* char and short are promoted */
+      }
+    case 'c':
+      return ARG_INT;
+    case 's':
+    case 'p':
+    case 'n':
+      return ARG_PTR;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+      return (c->len == LEN_BIG_L) ? ARG_LDOUBLE : ARG_DOUBLE;
+    default:
+      return ARG_NONE;
+  }
+}
+
+static union arg next_arg(va_list *ap, enum arg_type type) {
+  union arg a;
+
+  switch (type) {
+    case ARG_LONG:
+      a.l = va_arg(*ap, long);
+      break;
+    case ARG_LLONG:
+      a.ll = va_arg(*ap, long long);
+      break;
+    case ARG_SIZE:
+      a.z = va_arg(*ap, size_t);
+      break;
+    case ARG_INTMAX:
+      a.j = va_arg(*ap, intmax_t);
+      break;
+    case ARG_PTRDIFF:
+      a.t = va_arg(*ap, ptrdiff_t);
+      break;
+    case ARG_PTR:
+      a.p = va_arg(*ap, void *);
+      break;
+    case ARG_DOUBLE:
+      a.d = va_arg(*ap, double);
+      break;
+    case ARG_LDOUBLE: /* printed with the precision of a double */
+      a.d = va_arg(*ap, long double);
+      break;
+    default:
+      a.i = va_arg(*ap, int);
+      break;
+  }
+  return a;
+}
+
+/* Argument n (1-based) of a %n$ format, or the next one (n == 0) */
+static union arg get_arg(struct args *a, int n, enum arg_type type) {
+  if (n > 0) return a->pos[n];
+  return next_arg(&a->ap, type);
+}
+
+/* Parse "123" or "123$". Returns -1 on overflow */
+static int parse_num(const char **pp) {
+  const char *p = *pp;
+  int n = 0;
+
+  for (; *p >= '0' && *p <= '9'; ++p) {
+    if (n > (INT_MAX - 9) / 10) return -1;
+    n = n * 10 + (*p - '0');
+  }
+  *pp = p;
+  return n;
+}
+
+/* Parse '*' or '*n$' (returns -1 or n), or digits (*value). Returns
+ * -2 on error */
+static int parse_width(const char **pp, int *value) {
+  const char *p = *pp;
+
+  if (*p != '*') {
+    *value = -1;
+    if (*p >= '0' && *p <= '9') {
+      *value = parse_num(&p);
+      if (*value < 0) return -2;
+    }
+    *pp = p;
+    return 0;
+  }
+
+  ++p;
+  if (*p >= '0' && *p <= '9') {
+    const int n = parse_num(&p);
+    if (n <= 0 || n > FORMAT_ARGMAX || *p != '$') return -2;
+    *pp = p + 1;
+    return n;
+  }
+  *pp = p;
+  return -1;
+}
+
+/* Parse the conversion after '%'. Returns the position after it, or
+ * NULL if invalid */
+static const char *parse_conv(const char *p, struct conv *c) {
+  const char *q = p;
+  int n;
+
+  c->argpos = 0;
+  c->flags = 0;
+  c->prec = -1;
+  c->prec_arg = 0;
+  c->len = LEN_NONE;
+
+  /* %n$ */
+  if (*q >= '1' && *q <= '9') {
+    n = parse_num(&q);
+    if (*q == '$') {
+      if (n <= 0 || n > FORMAT_ARGMAX) return NULL;
+      c->argpos = n;
+      p = q + 1;
+    }
+  }
+
+  for (;; ++p) {
+    if (*p == '-')
+      c->flags |= FLAG_LEFT;
+    else if (*p == '+')
+      c->flags |= FLAG_PLUS;
+    else if (*p == ' ')
+      c->flags |= FLAG_SPACE;
+    else if (*p == '#')
+      c->flags |= FLAG_ALT;
+    else if (*p == '0')
+      c->flags |= FLAG_ZERO;
+    else
+      break;
+  }
+
+  c->width_arg = parse_width(&p, &c->width);
+  if (c->width_arg == -2) return NULL;
+
+  if (*p == '.') {
+    ++p;
+    if (*p == '*' || (*p >= '0' && *p <= '9')) {
+      c->prec_arg = parse_width(&p, &c->prec);
+      if (c->prec_arg == -2) return NULL;
+    } else {
+      c->prec = 0;
+    }
+  }
+
+  switch (*p) {
+    case 'h':
+      c->len = (p[1] == 'h') ? LEN_HH : LEN_H;
+      p += (p[1] == 'h') ? 2 : 1;
+      break;
+    case 'l':
+      c->len = (p[1] == 'l') ? LEN_LL : LEN_L;
+      p += (p[1] == 'l') ? 2 : 1;
+      break;
+    case 'z':
+      c->len = LEN_Z;
+      ++p;
+      break;
+    case 'j':
+      c->len = LEN_J;
+      ++p;
+      break;
+    case 't':
+      c->len = LEN_T;
+      ++p;
+      break;
+    case 'L':
+      c->len = LEN_BIG_L;
+      ++p;
+      break;
+  }
+
+  c->type = *p;
+  return (*p != '\0') ? p + 1 : NULL;
+}
+
+/* First pass over a format using %n$: find the type of each argument,
+ * then fetch them all in order. Returns 0 or -1 (invalid format) */
+static int fetch_positional(const char *format, va_list *ap,
+                            union arg *pos) {
+  unsigned char types[FORMAT_ARGMAX + 1];
+  struct conv c;
+  int i, max = 0;
+
+  memset(types, ARG_NONE, sizeof(types));
+
+  for (format = strchr(format, '%'); format != NULL;
+       format = strchr(format, '%')) {
+    if (format[1] == '%') {
+      format += 2;
+      continue;
+    }
+
+    format = parse_conv(format + 1, &c);
+    if (format == NULL || c.argpos == 0 || c.width_arg < 0 ||
+        c.prec_arg < 0)
+      return -1; /* no mixing %n$ with plain conversions */
+
+    types[c.argpos] = conv_arg_type(&c);
+    if (c.argpos > max) max = c.argpos;
+    if (c.width_arg > 0) types[c.width_arg] = ARG_INT;
+    if (c.width_arg > max) max = c.width_arg;
+    if (c.prec_arg > 0) types[c.prec_arg] = ARG_INT;
+    if (c.prec_arg > max) max = c.prec_arg;
+  }
+
+  for (i = 1; i <= max; ++i) {
+    if (types[i] == ARG_NONE) return -1; /* can't skip an argument */
+    pos[i] = next_arg(ap, types[i]);
+  }
+  return 0;
+}
+
+/* The conversion c, with its arguments from a. Returns 0, 1 if c is
+ * not supported, or -1 */
+static int format_conv(struct out *o, struct conv *c, struct args *a) {
+  const enum arg_type type = conv_arg_type(c);
+  union arg v;
+
+  if (c->width_arg != 0) {
+    c->width = get_arg(a, c->width_arg > 0 ? c->width_arg : 0, ARG_INT).i;
+    if (c->width < 0) {
+      if (c->width < -INT_MAX) return -1;
+      c->flags |= FLAG_LEFT;
+      c->width = -c->width;
+    }
+  }
+  if (c->prec_arg != 0) {
+    c->prec = get_arg(a, c->prec_arg > 0 ? c->prec_arg : 0, ARG_INT).i;
+    if (c->prec < 0) c->prec = -1;
+  }
+  if (c->width < 0) c->width = 0;
+
+  if (type == ARG_NONE) return 1;
+  v = get_arg(a, c->argpos, type);
+
+  switch (c->type) {
+    case 'd':
+    case 'i': {
+      intmax_t sv;
+      switch (c->len) {
+        case LEN_HH:
+          sv = (signed char)v.i;
+          break;
+        case LEN_H:
+          sv = (short)v.i;
+          break;
+        case LEN_L:
+          sv = v.l;
+          break;
+        case LEN_LL:
+          sv = v.ll;
+          break;
+        case LEN_Z:
+          sv = (ssize_t)v.z;
+          break;
+        case LEN_J:
+          sv = v.j;
+          break;
+        case LEN_T:
+          sv = v.t;
+          break;
+        default:
+          sv = v.i;
+          break;
+      }
+      if (sv < 0)
+        format_int(o, c, -(uintmax_t)sv, 1);
+      else
+        format_int(o, c, sv, 0);
+      break;
+    }
+
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X': {
+      uintmax_t uv;
+      switch (c->len) {
+        case LEN_HH:
+          uv = (unsigned char)v.i;
+          break;
+        case LEN_H:
+          uv = (unsigned short)v.i;
+          break;
+        case LEN_L:
+          uv = (unsigned long)v.l;
+          break;
+        case LEN_LL:
+          uv = (unsigned long long)v.ll;
+          break;
+        case LEN_Z:
+          uv = v.z;
+          break;
+        case LEN_J:
+          uv = (uintmax_t)v.j;
+          break;
+        case LEN_T:
+          uv = (size_t)v.t;
+          break;
+        default:
+          uv = (unsigned)v.i;
+          break;
+      }
+      format_int(o, c, uv, 0);
+      break;
+    }
+
+    case 'p':
+      if (v.p == NULL) {
+        field(o, c, "(nil)", 5);
+      } else {
+        c->flags |= FLAG_ALT;
+        format_int(o, c, (uintptr_t)v.p, 0);
+      }
+      break;
+
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+      format_float(o, c, v.d);
+      break;
+
+    case 'c': {
+      const char ch = (unsigned char)v.i;
+      field(o, c, &ch, 1);
+      break;
+    }
+
+    case 's': {
+      const char *s = v.p;
+      if (s == NULL) s = (c->prec < 0 || c->prec >= 6) ? "(null)" : "";
+      field(o, c, s, (c->prec < 0) ? strlen(s) : strnlen(s, c->prec));
+      break;
+    }
+
+    case 'n':
+      switch (c->len) {
+        case LEN_HH:
+          *(signed char *)v.p = o->total;
+          break;
+        case LEN_H:
+          *(short *)v.p = o->total;
+          break;
+        case LEN_L:
+          *(long *)v.p = o->total;
+          break;
+        case LEN_LL:
+          *(long long *)v.p = o->total;
+          break;
+        case LEN_Z:
+          *(size_t *)v.p = o->total;
+          break;
+        case LEN_J:
+          *(intmax_t *)v.p = o->total;
+          break;
+        case LEN_T:
+          *(ptrdiff_t *)v.p = o->total;
+          break;
+        default:
+          *(int *)v.p = o->total;
+          break;
+      }
+      break;
+  }
+
+  return 0;
+}
+
+int __nnlc_format(void *ctx, nnlc_emit_t emit, const char *format,
+                  va_list ap) {
+  union arg pos[FORMAT_ARGMAX + 1];
+  struct args a;
+  struct out o;
+  struct conv c;
+  const char *p;
+  int rc = 0;
+
+  o.ctx = ctx;
+  o.emit = emit;
+  o.total = 0;
+
+  va_copy(a.ap, ap);
+  a.pos = NULL;
+
+  /* %n$ in the first conversion: all of them have it */
+  for (p = strchr(format, '%'); p != NULL && p[1] == '%';
+       p = strchr(p + 2, '%')) {
+  }
+  if (p != NULL && p[1] >= '1' && p[1] <= '9') {
+    const char *q = p + 1;
+    while (*q >= '0' && *q <= '9') ++q;
+    if (*q == '$') {
+      if (fetch_positional(format, &a.ap, pos)) rc = -1;
+      a.pos = pos;
+    }
+  }
+
+  while (rc == 0) {
+    /* literal run up to the next conversion */
+    p = strchr(format, '%');
+    if (p == NULL) {
+      out(&o, format, strlen(format));
+      break;
+    }
+    out(&o, format, p - format);
+
+    if (p[1] == '%') {
+      out(&o, "%", 1);
+      format = p + 2;
+      continue;
+    }
+
+    format = parse_conv(p + 1, &c);
+    if (format == NULL || (a.pos == NULL && (c.argpos != 0 ||
+                                             c.width_arg > 0 ||
+                                             c.prec_arg > 0))) {
+      rc = -1;
+      break;
+    }
+    rc = format_conv(&o, &c, &a);
+    if (rc == 1) { /* printed as is */
+      out(&o, p, format - p);
+      rc = 0;
+    }
+  }
+
+  va_end(a.ap);
+  if (rc != 0 || o.total > INT_MAX) return -1;
+  return o.total;
+}
@@ -35,6 +35,81 @@ void *calloc(size_t num, size_t size);
 void free(void *ptr);
 void *realloc(void *ptr, size_t size);
 
+/* Data aligned on 'alignment' bytes, a power of 2. free() and
+ * realloc() work as usual on these blocks, but realloc() does not
+ * preserve the alignment if it has to move the data. */
+void *memalign(size_t alignment, size_t size);
+void *valloc(size_t size); /* page-aligned */
+
+/* Number of bytes actually usable in the block, >= the size requested
+ * when it was (re)allocated */
+size_t malloc_usable_size(void *ptr);
+
+/* Heap statistics, all 0 unless nanolibc is built with
+ * NNLC_MALLOC_STATS defined:
+ *  - arena: bytes obtained from the runtime malloc
+ *  - hblks/hblkhd: blocks/bytes obtained from the runtime page allocator
+ *  - usmblks: peak of uordblks
+ *  - uordblks: usable bytes in the allocated blocks
+ *  - fordblks: bytes available in the free lists and current chunk
+ * Other fields are always 0. Blocks allocated from an arena are not
+ * accounted. */
+struct mallinfo2 {
+  size_t arena, ordblks, smblks, hblks, hblkhd;
+  size_t usmblks, fsmblks, uordblks, fordblks, keepcost;
+};
+struct mallinfo2 mallinfo2(void);
+
+/* Same as mallinfo2(), with fields truncated to int */
+struct mallinfo {
+  int arena, ordblks, smblks, hblks, hblkhd;
+  int usmblks, fsmblks, uordblks, fordblks, keepcost;
+};
+struct mallinfo mallinfo(void);
+
+/* Print more detailed heap statistics (number of calls to the
+ * runtime, allocations per size class, etc.) to given stream */
+struct _FILE_DESCR;
+void nnlc_malloc_stats(struct _FILE_DESCR *stream);
+
+/* With NNLC_DEBUG_HEAP, check the redzones of the blocks in use and
+ * report the corrupted ones to given stream (if not NULL). Returns
+ * their number, always 0 without NNLC_DEBUG_HEAP */
+int nnlc_malloc_check(struct _FILE_DESCR *stream);
+
+/*
+ * nanolibc arenas: blocks are allocated with O(1) pointer bumps in
+ * large chunks, and are all released together by
+ * nnlc_arena_rewind() or nnlc_arena_destroy(). There is no per-block
+ * free. Blocks are aligned on NNLC_MALLOC_ALIGNMENT.
+ */
+struct nnlc_arena;
+
+/* Opaque position in an arena, see nnlc_arena_rewind() */
+struct nnlc_arena_mark {
+  void *chunk;
+  void *next;
+};
+
+/* chunk_size is the size of the chunks requested from the runtime, 0
+ * for a default. Return NULL when out of memory. */
+struct nnlc_arena *nnlc_arena_create(size_t chunk_size);
+void nnlc_arena_destroy(struct nnlc_arena *arena);
+
+/* Return NULL when out of memory, or possibly when size == 0 */
+void *nnlc_arena_alloc(struct nnlc_arena *arena, size_t size);
+
+/* Release all the blocks allocated after nnlc_arena_get_mark()
+ * returned 'mark' */
+struct nnlc_arena_mark nnlc_arena_get_mark(struct nnlc_arena *arena);
+void nnlc_arena_rewind(struct nnlc_arena *arena, struct nnlc_arena_mark mark);
+
+/* While 'arena' is not NULL, malloc() (and calloc(), realloc(), etc.)
+ * allocate from it, and free() ignores the blocks it returned: they
+ * must not be used after the arena is rewound or destroyed. Return
+ * the arena previously in use, or NULL. */
+struct nnlc_arena *nnlc_malloc_use_arena(struct nnlc_arena *arena);
+
 __END_DECLS
 
 #endif  // THIRD_PARTY_NANOLIBC_C_INCLUDE_MALLOC_H_
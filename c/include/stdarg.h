@@ -26,5 +26,6 @@ __END_DECLS
 #define va_start(v, l) __builtin_va_start(v, l)
 #define va_end(v) __builtin_va_end(v)
 #define va_arg(v, l) __builtin_va_arg(v, l)
+#define va_copy(d, s) __builtin_va_copy(d, s)
 
 #endif  // THIRD_PARTY_NANOLIBC_C_INCLUDE_STDARG_H_
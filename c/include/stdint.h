@@ -46,4 +46,11 @@
 #define UINT32_MAX UINT32_C(4294967295)
 #define UINT64_MAX UINT64_C(18446744073709551615)
 
+typedef __INTMAX_TYPE__ intmax_t;
+typedef __UINTMAX_TYPE__ uintmax_t;
+
+#define INTMAX_MAX __INTMAX_MAX__
+#define INTMAX_MIN (-INTMAX_MAX - 1)
+#define UINTMAX_MAX __UINTMAX_MAX__
+
 #endif  // THIRD_PARTY_NANOLIBC_C_INCLUDE_STDINT_H_
@@ -28,26 +28,82 @@ __BEGIN_DECLS
 
 #define EOF (-1)
 
+/* setvbuf() modes */
+#define _IOFBF 0 /* fully buffered */
+#define _IOLBF 1 /* line buffered */
+#define _IONBF 2 /* unbuffered */
+
+#define BUFSIZ 8192
+
 typedef struct _FILE_DESCR FILE;
 
 extern FILE *stdout;
 extern FILE *stderr;
 
-int vsnprintf(char *str, size_t size, const char *format, va_list ap);
+int vsnprintf(char *str, size_t size, const char *format, va_list ap)
+    __attribute__((format(printf, 3, 0)));
 int snprintf(char *str, size_t size, const char *format, ...)
     __attribute__((format(printf, 3, 4)));
 
-int vsprintf(char *str, const char *format, va_list ap);
+int vsprintf(char *str, const char *format, va_list ap)
+    __attribute__((format(printf, 2, 0)));
 int sprintf(char *str, const char *format, ...)
     __attribute__((format(printf, 2, 3)));
 
-int vfprintf(FILE *stream, const char *format, va_list ap);
+int vfprintf(FILE *stream, const char *format, va_list ap)
+    __attribute__((format(printf, 2, 0)));
 int fprintf(FILE *stream, const char *format, ...)
     __attribute__((format(printf, 2, 3)));
 
-int vprintf(const char *format, va_list ap);
+int vprintf(const char *format, va_list ap)
+    __attribute__((format(printf, 1, 0)));
 int printf(const char *format, ...) __attribute__((format(printf, 1, 2)));
 
+/* The output goes to a string allocated with malloc(), to be free()'d
+ * by the caller. Return -1 if out of memory */
+int vasprintf(char **strp, const char *format, va_list ap)
+    __attribute__((format(printf, 2, 0)));
+int asprintf(char **strp, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/*
+ * nanolibc string builders: output is appended to a heap buffer that
+ * doubles in size when full. nnlc_strbuf_reset() empties the builder
+ * but keeps the buffer, so a builder reused for every log record
+ * stops allocating once it has grown to the largest record.
+ */
+#define NNLC_STRBUF
+
+struct nnlc_strbuf {
+  char *buf;  /* NUL-terminated, NULL until something is appended */
+  size_t len; /* excluding the NUL */
+  size_t cap; /* size of buf */
+  int error;  /* out of memory: the output is truncated */
+};
+
+#define NNLC_STRBUF_INIT {NULL, 0, 0, 0}
+
+void nnlc_strbuf_init(struct nnlc_strbuf *sb);
+void nnlc_strbuf_reset(struct nnlc_strbuf *sb);
+void nnlc_strbuf_free(struct nnlc_strbuf *sb);
+
+/* The contents, "" if empty */
+const char *nnlc_strbuf_str(const struct nnlc_strbuf *sb);
+
+/* Hand the buffer over to the caller, who will free() it. The
+ * builder is empty afterwards. Returns NULL if out of memory */
+char *nnlc_strbuf_release(struct nnlc_strbuf *sb);
+
+/* Return 0, or -1 if out of memory */
+int nnlc_strbuf_append(struct nnlc_strbuf *sb, const char *s, size_t n);
+
+/* Return the number of bytes appended, or -1 (out of memory, invalid
+ * format) */
+int nnlc_strbuf_vprintf(struct nnlc_strbuf *sb, const char *format,
+                        va_list ap) __attribute__((format(printf, 2, 0)));
+int nnlc_strbuf_printf(struct nnlc_strbuf *sb, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
 int fputc(int c, FILE *stream);
 int fputs(const char *s, FILE *stream);
 int putc(int c, FILE *stream);
@@ -56,28 +112,76 @@ int puts(const char *s);
 
 size_t fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream);
 
-int fflush(FILE *stream);
+/* stdout is line buffered, stderr is unbuffered. setvbuf() may be
+ * called at any time: pending output is flushed first. With buf ==
+ * NULL, a buffer of 'size' bytes is allocated (BUFSIZ if 0) */
+int setvbuf(FILE *stream, char *buf, int mode, size_t size);
+void setbuf(FILE *stream, char *buf);
 
-int perror(const char *s);
+/* fflush(NULL) flushes stdout, stderr and the streams open */
+int fflush(FILE *stream);
 
-/*
- * Published but functions NOT implemented!
- */
+/* Memory streams, for writing only: fmemopen() modes are "w", "a",
+ * "r+", "w+" and "a+". With buf == NULL, fmemopen() allocates size
+ * bytes. A NUL byte follows the data written when there is room.
+ * open_memstream() keeps *ptr (to be free()'d by the caller after
+ * fclose()) and *sizeloc up to date after each write reaching the
+ * stream. */
+FILE *fmemopen(void *buf, size_t size, const char *mode);
+FILE *open_memstream(char **ptr, size_t *sizeloc);
+
+/* stdin reads from the runtime (always at EOF if it cannot), with a
+ * BUFSIZ buffer: fread(), fgetc(), fgets() and getline() work on
+ * stdin like on files */
 extern FILE *stdin;
+int getchar(void);
 
-#define SEEK_SET 0
-#define SEEK_CUR 1
-#define SEEK_END 2
-
-int scanf(const char *format, ...);
-int sscanf(const char *str, const char *format, ...);
+/* Files, from the file system of the runtime (fopen() fails with
+ * ENOENT without one). They are fully buffered with NNLC_FILE_BUF_SIZE
+ * bytes, reads larger than that bypass the buffer. fseek() and ftell()
+ * support memory streams too. */
 FILE *fopen(const char *path, const char *mode);
-int fclose(FILE *fp);
-char *fgets(char *s, int size, FILE *stream);
+int remove(const char *path);
 size_t fread(void *ptr, size_t size, size_t nmemb, FILE *stream);
+int fgetc(FILE *stream);
+int getc(FILE *stream);
+char *fgets(char *s, int size, FILE *stream);
+
+/* *lineptr is malloc()'ed or grown with realloc() as needed */
+ssize_t getline(char **lineptr, size_t *n, FILE *stream);
+ssize_t getdelim(char **lineptr, size_t *n, int delim, FILE *stream);
 int fseek(FILE *stream, long offset, int whence);
 long ftell(FILE *stream);
 void rewind(FILE *stream);
+int feof(FILE *stream);
+int ferror(FILE *stream);
+void clearerr(FILE *stream);
+
+#define SEEK_SET 0
+#define SEEK_CUR 1
+#define SEEK_END 2
+
+/* The whole file at path, read-only, without stdio buffering: mapped
+ * by the runtime when it can, else read at once into pages of
+ * memory. Returns NULL (and sets errno) on errors. The data must be
+ * released with nnlc_unmap_file(). */
+#define NNLC_MAP_FILE
+const void *nnlc_map_file(const char *path, size_t *size);
+void nnlc_unmap_file(const void *data, size_t size);
+
+/* Files and memory streams are released, stdout and stderr are only
+ * flushed */
+int fclose(FILE *fp);
+
+int perror(const char *s);
+
+/*
+ * Published but functions NOT implemented!
+ */
+
+int scanf(const char *format, ...) __attribute__((format(scanf, 1, 2)));
+int sscanf(const char *str, const char *format, ...)
+    __attribute__((format(scanf, 2, 3)));
 
 __END_DECLS
 
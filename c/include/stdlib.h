@@ -35,6 +35,10 @@ long atol(const char *nptr);
 float strtof(const char *nptr, char **endptr);
 double strtod(const char *nptr, char **endptr);
 
+/* see also memalign() in malloc.h */
+void *aligned_alloc(size_t alignment, size_t size);
+int posix_memalign(void **memptr, size_t alignment, size_t size);
+
 void exit(int status) __attribute__((noreturn));
 void abort(void) __attribute__((noreturn));
 
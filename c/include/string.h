@@ -27,15 +27,35 @@ void *memset(void *dstpp, int c, size_t n);
 void *memchr(const void *spp, int c, size_t n);
 const void *rawmemchr(const void *spp, int c);
 
+/* nanolibc extension: return non-zero iff the n bytes at p1 and p2 are
+ * equal. Faster than memcmp() when the order does not matter. */
+#define NNLC_MEMEQ
+int nnlc_memeq(const void *p1, const void *p2, size_t n);
+
+void *memrchr(const void *spp, int c, size_t n);
+void *memmem(const void *haystack, size_t hlen, const void *needle,
+             size_t nlen);
+void *memccpy(void *dstpp, const void *srcpp, int c, size_t n);
+
 int strcmp(const char *p1, const char *p2);
 char *strcpy(char *dest, const char *src);
+char *stpcpy(char *dest, const char *src);
 size_t strlen(const char *s);
+size_t strnlen(const char *s, size_t maxlen);
 int strncmp(const char *s1, const char *s2, size_t n);
 char *strncpy(char *dest, const char *src, size_t n);
+char *stpncpy(char *dest, const char *src, size_t n);
+char *strcat(char *dest, const char *src);
+char *strncat(char *dest, const char *src, size_t n);
+/* BSD: always '\0'-terminate dest (if size > 0), return the length of
+ * the string they tried to create */
+size_t strlcpy(char *dest, const char *src, size_t size);
+size_t strlcat(char *dest, const char *src, size_t size);
 char *strchr(const char *s, int i);
 char *strrchr(const char *s, int i);
 const char *strstr(const char *haystack, const char *needle);
 size_t strspn(const char *s, const char *accept);
+size_t strcspn(const char *s, const char *reject);
 const char *strpbrk(const char *s, const char *accept);
 
 // These two are unsupported.
@@ -28,12 +28,14 @@ ssize_t write(int fd, const void *buf, size_t count);
 #define STDOUT_FILENO 1
 #define STDERR_FILENO 2
 
+/* Only for STDIN_FILENO, after what stdin has buffered */
+ssize_t read(int fd, void *buf, size_t count);
+
 /*
  * Published but functions NOT implemented!
  */
 int isatty(int fd);
 int getopt(int argc, char * const argv[], const char *optstring);
-ssize_t read(int fd, void *buf, size_t count);
 
 /*
  * Global variables.
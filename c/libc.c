@@ -17,24 +17,70 @@
  */
 
 #include <stddef.h>
+#include <stdio.h>
 
 #include "third_party/nanolibc/c/libc_internals.h"
 
 /* nanolibc internal state */
 struct nnlc_internal_data __nnlc_internal_data;
 
+/* TRUE once _nnlc_finalize() was called */
+static int finalized;
+
+/* stdin is fully buffered, stdout is line buffered, stderr is not
+ * buffered */
+static char stdin_buf[BUFSIZ];
+static char stdout_buf[BUFSIZ];
+
+static void init_stream(FILE *stream, ssize_t (*write)(const void *, size_t),
+                        ssize_t (*writev)(const struct nnlc_iovec *, int),
+                        int mode, char *buf, size_t buf_size) {
+  stream->magic = _NNLC_STDIO_MAGIC;
+  stream->write = write;
+  stream->writev = writev;
+  stream->read = NULL;
+  stream->mem = NULL;
+  stream->handle = -1;
+  stream->flags = 0;
+  stream->mode = mode;
+  stream->buf_owned = 0;
+  stream->buf = buf;
+  stream->buf_size = buf_size;
+  stream->buf_used = 0;
+  stream->in_pos = 0;
+  stream->in_len = 0;
+  stream->next_open = NULL;
+}
+
 /* prepare libc services */
 int _nnlc_initialize(struct nnlc_sysdeps const* sysdeps) {
   __nnlc_internal_data.sysdeps = sysdeps;
+  finalized = 0;
+  __nnlc_internal_data.cpu_features = __nnlc_detect_cpu_features();
+#if defined(__x86_64__)
+  __nnlc_select_string_ops(__nnlc_internal_data.cpu_features);
+#endif
 
-  __nnlc_internal_data.libc_stdin.magic = _NNLC_STDIO_MAGIC;
-  __nnlc_internal_data.libc_stdin.write = NULL;
+  init_stream(&__nnlc_internal_data.libc_stdin, NULL, NULL, _IOFBF, stdin_buf,
+              sizeof(stdin_buf));
+  if (sysdeps->read_stdin != NULL) {
+    __nnlc_internal_data.libc_stdin.read = sysdeps->read_stdin;
+    __nnlc_internal_data.libc_stdin.flags = _NNLC_F_READ;
+  }
+  init_stream(&__nnlc_internal_data.libc_stdout, sysdeps->write_stdout,
+              sysdeps->writev_stdout, _IOLBF, stdout_buf,
+              sizeof(stdout_buf));
+  init_stream(&__nnlc_internal_data.libc_stderr, sysdeps->write_stderr,
+              sysdeps->writev_stderr, _IONBF, NULL, 0);
 
-  __nnlc_internal_data.libc_stdout.magic = _NNLC_STDIO_MAGIC;
-  __nnlc_internal_data.libc_stdout.write = sysdeps->write_stdout;
+  return 0;
+}
 
-  __nnlc_internal_data.libc_stderr.magic = _NNLC_STDIO_MAGIC;
-  __nnlc_internal_data.libc_stderr.write = sysdeps->write_stderr;
+/* release/report libc resources before program terminates */
+void _nnlc_finalize(void) {
+  if (finalized) return;
+  finalized = 1;
 
-  return 0;
+  __nnlc_stdio_finalize();
+  __nnlc_malloc_finalize();
 }
@@ -25,9 +25,30 @@
 #include <stdint.h>
 #include <sys/types.h>
 
-/* Hooks to underlying runtime, all function pointers must be defined */
+/* Granularity of the alloc_pages/free_pages hooks below */
+#define NNLC_PAGE_SIZE 4096
+
+/* Flags of the file_open hook below */
+#define NNLC_FILE_READ 0x1
+#define NNLC_FILE_WRITE 0x2
+#define NNLC_FILE_CREATE 0x4 /* create the file if it does not exist */
+#define NNLC_FILE_TRUNC 0x8  /* empty the file if it exists */
+
+/* Size of the buffer of the streams returned by fopen() */
+#define NNLC_FILE_BUF_SIZE (64 * 1024)
+
+/* A piece of a gather write, same layout as POSIX struct iovec */
+struct nnlc_iovec {
+  const void *iov_base;
+  size_t iov_len;
+};
+
+/* Hooks to underlying runtime, all function pointers must be defined
+ * unless marked optional */
 struct nnlc_sysdeps {
-  /* the size passed to runtime is guaranteed to be > 0 */
+  /* the size passed to runtime is guaranteed to be > 0. The memory
+   * returned must be aligned on 8 bytes at least: nanolibc keeps
+   * tags in the low bits of these addresses. */
   void *(*malloc)(size_t);
 
   /* the pointer passed to runtime is guaranteed to be != NULL */
@@ -55,6 +76,59 @@ struct nnlc_sysdeps {
    * passed to runtime are guaranteed to be != NULL. epoch starts at
    * 1970-01-01 00:00:00.0 UTC. */
   int (*gettime_wall)(uint64_t *secs, uint64_t *nanosecs);
+
+  /* Optional (may be NULL, then large blocks come from malloc
+   * above). Return npages * NNLC_PAGE_SIZE bytes aligned on
+   * NNLC_PAGE_SIZE, or NULL. npages passed to runtime is guaranteed
+   * to be > 0. */
+  void *(*alloc_pages)(size_t npages);
+
+  /* Optional, must be defined if alloc_pages is. Release npages
+   * starting at given page-aligned address, which may be any
+   * sub-range of what alloc_pages returned. */
+  void (*free_pages)(void *, size_t npages);
+
+  /* Non-zero if the memory returned by alloc_pages is always
+   * zero-filled (eg. fresh anonymous mappings), calloc() then does
+   * not clear it again. */
+  int alloc_pages_zeroed;
+
+  /* Optional (may be NULL, then the pieces go to write_stdout and
+   * write_stderr one at a time). Write the iovcnt > 0 pieces in
+   * order, as a single operation if possible, and return the total
+   * number of bytes actually printed. */
+  ssize_t (*writev_stdout)(const struct nnlc_iovec *, int iovcnt);
+  ssize_t (*writev_stderr)(const struct nnlc_iovec *, int iovcnt);
+
+  /* Optional file system (all NULL, or all defined): fopen() fails
+   * with ENOENT without it. Paths use '/' as separator. file_open()
+   * takes NNLC_FILE_* flags and returns a handle >= 0. file_seek()
+   * takes SEEK_SET/SEEK_CUR/SEEK_END and returns the new offset.
+   * file_read() returns 0 at the end of the file. file_remove()
+   * deletes a file that is not open. All return a
+   * negative errno value (eg. -ENOENT) on errors. nanolibc buffers
+   * the data, so reads and writes are large (NNLC_FILE_BUF_SIZE) */
+  intptr_t (*file_open)(const char *path, int flags);
+  ssize_t (*file_read)(intptr_t handle, void *buf, size_t size);
+  ssize_t (*file_write)(intptr_t handle, const void *buf, size_t size);
+  int64_t (*file_seek)(intptr_t handle, int64_t offset, int whence);
+  int (*file_close)(intptr_t handle);
+  int (*file_remove)(const char *path);
+
+  /* Optional (may be NULL, then nnlc_map_file() reads the whole file
+   * with the file_* hooks above). Map the file read-only, returns 0 or
+   * a negative errno value. *data may be any non-NULL pointer for an
+   * empty file: unmap_file() is never called with size == 0. */
+  int (*map_file)(const char *path, const void **data, size_t *size);
+  void (*unmap_file)(const void *data, size_t size);
+
+  /* Optional (may be NULL, then stdin is always at EOF). Block until
+   * some input is available, and return the number of bytes stored
+   * (<= size), 0 at the end of the input, or a negative errno
+   * value. size may be anything >= 1: nanolibc fills its BUFSIZ
+   * stdin buffer with it, but unbuffered stdin reads 1 byte at a
+   * time and read() passes the size given by its caller. */
+  ssize_t (*read_stdin)(void *buf, size_t size);
 };
 
 /* After this function has been called, nanolibc is fully
@@ -64,4 +138,9 @@ struct nnlc_sysdeps {
  * anymore (eg. program terminates, etc.). */
 int _nnlc_initialize(struct nnlc_sysdeps const *sysdeps);
 
+/* Runtimes call this function after main() returned. exit() calls it
+ * too, before calling into the runtime. Only the first call after
+ * _nnlc_initialize() does anything. */
+void _nnlc_finalize(void);
+
 #endif  // THIRD_PARTY_NANOLIBC_C_LIBC_H_
@@ -18,22 +18,107 @@
 #ifndef THIRD_PARTY_NANOLIBC_C_LIBC_INTERNALS_H_
 #define THIRD_PARTY_NANOLIBC_C_LIBC_INTERNALS_H_
 
+#include <stdarg.h>
 #include <sys/types.h>
 
 #include "third_party/nanolibc/c/libc.h"
 
-/* Internal definition of a nanolibc FILE* */
+/* Internal definition of a nanolibc FILE*. Output goes to buf
+ * (unless mode is _IONBF) and reaches write() when buf is full, on
+ * '\n' for _IOLBF streams, and on fflush(). Memory streams have no
+ * write(), their output is copied to memory instead. Streams from
+ * fopen() go to the file system hooks of the runtime. Streams that
+ * read (stdin, files) keep the input they read ahead in buf too. See
+ * stdio.c */
+struct _mem_stream;
 struct _FILE_DESCR {
 #define _NNLC_STDIO_MAGIC 0x785789
   int magic;
   ssize_t (*write)(const void *, size_t);
+  ssize_t (*writev)(const struct nnlc_iovec *, int); /* may be NULL */
+  ssize_t (*read)(void *, size_t); /* stdin, or NULL */
+  struct _mem_stream *mem; /* fmemopen(), open_memstream(), or NULL */
+  intptr_t handle;         /* fopen(): handle of the runtime, else -1 */
+#define _NNLC_F_READ 0x1
+#define _NNLC_F_WRITE 0x2
+#define _NNLC_F_APPEND 0x4
+#define _NNLC_F_EOF 0x8
+#define _NNLC_F_ERR 0x10
+  int flags;        /* _NNLC_F_*, for the streams that read or a handle */
+  int mode;         /* _IOFBF, _IOLBF or _IONBF */
+  int buf_owned;    /* buf was malloc()'ed by setvbuf() or fopen() */
+  char *buf;
+  size_t buf_size;
+  size_t buf_used;  /* output */
+  size_t in_pos;    /* input: buf[in_pos..in_len) */
+  size_t in_len;
+  char in_byte;     /* input buffer of unbuffered streams */
+  struct _FILE_DESCR *next_open; /* list of the streams to flush */
 };
 
 /* Internal definition of the nanolibc state */
 struct nnlc_internal_data {
   struct _FILE_DESCR libc_stdin, libc_stdout, libc_stderr;
   struct nnlc_sysdeps const *sysdeps;
+  unsigned cpu_features; /* NNLC_CPU_* */
 };
 extern struct nnlc_internal_data __nnlc_internal_data;
 
+/* CPU features, as far as nanolibc is concerned (always 0 on other
+ * architectures than x86-64) */
+#define NNLC_CPU_ERMS 0x1   /* fast rep movsb/stosb */
+#define NNLC_CPU_SSE42 0x2  /* SSE4.2 */
+#define NNLC_CPU_AVX2 0x4   /* AVX2, and its state enabled by the OS */
+#define NNLC_CPU_AVX512 0x8 /* AVX-512 F+BW, and its state enabled */
+
+/* Called by _nnlc_initialize(), see cpu.c */
+unsigned __nnlc_detect_cpu_features(void);
+
+/* memmem() for needles of 2 to NNLC_MEMMEM_SHORT bytes, see
+ * string.c and string_x86_64.c */
+#define NNLC_MEMMEM_SHORT 32
+const char *__nnlc_memmem_short(const char *h, size_t hlen, const char *n,
+                                size_t nlen);
+
+#if defined(__x86_64__)
+/* strspn() (reject == 0) or strcspn() (reject != 0) for sets of up
+ * to 16 bytes, on CPUs with NNLC_CPU_SSE42. Return (size_t)-1 for
+ * larger sets. See string_x86_64.c */
+size_t __nnlc_span_sse42(const char *s, const char *set, int reject);
+
+/* Called by _nnlc_initialize(), pick the string.h functions best
+ * suited to the CPU, see string_x86_64.c */
+void __nnlc_select_string_ops(unsigned cpu_features);
+#endif
+
+/* printf engine, see format.c. The output is passed to emit() as
+ * spans: runs of the format, whole converted fields. Returns the
+ * number of bytes produced, or -1 (invalid format, more than INT_MAX
+ * bytes) */
+typedef void (*nnlc_emit_t)(void *ctx, const char *s, size_t n);
+int __nnlc_format(void *ctx, nnlc_emit_t emit, const char *format,
+                  va_list ap);
+
+/* Decimal digits of a double, see dtoa.c: the value is
+ * d[0].d[1]...d[n-1] * 10^e, without trailing zeros, n == 0 for 0 */
+#define NNLC_DECIMAL_DIGITS 780 /* 2^-1074 has 751 */
+struct nnlc_decimal {
+  int n;
+  int e;
+  char digits[NNLC_DECIMAL_DIGITS];
+};
+
+/* |v| (finite) rounded to prec significant digits (prec >= 1), or to
+ * prec digits after the decimal point */
+#define NNLC_DTOA_SIG 0
+#define NNLC_DTOA_FIXED 1
+void __nnlc_dtoa(double v, int mode, int prec, struct nnlc_decimal *d);
+
+/* Called by _nnlc_finalize(): flush the streams, leave them
+ * unbuffered. See stdio.c */
+void __nnlc_stdio_finalize(void);
+
+/* Called by _nnlc_finalize() */
+void __nnlc_malloc_finalize(void);
+
 #endif  // THIRD_PARTY_NANOLIBC_C_LIBC_INTERNALS_H_
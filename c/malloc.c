@@ -13,29 +13,64 @@
 // limitations under the License.
 
 /*
- * malloc/free trampolines to underlying runtime.
+ * malloc/free implementation on top of the underlying runtime.
+ *
+ * Small requests (up to NNLC_SLAB_MAX_SIZE bytes) are served from
+ * segregated size-class free lists, carved out of large chunks
+ * obtained from the runtime. Large requests (NNLC_PAGES_MIN_SIZE
+ * bytes and more) come page-aligned from the runtime page allocator
+ * when it has one. Other requests are trampolines to the underlying
+ * runtime malloc/free.
+ *
+ * Define NNLC_MALLOC_STATS to compile in the counters reported by
+ * mallinfo2() and nnlc_malloc_stats(). Define NNLC_DEBUG_HEAP to
+ * check for buffer overflows, writes after free and leaks (see
+ * below).
  */
 
+#include <assert.h>
+#include <errno.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <malloc.h>
 
 #include "third_party/nanolibc/c/libc_internals.h"
 
-/* Little malloc header required for realloc (memcpy)
+/* Little malloc header required for realloc (memcpy) and free
 
    To deal with this, dynamically align the data to 16 bytes regardless of the
    alignment returned by the underlying malloc implementation.  */
 struct malloc_block {
-  void *mem;  /* The pointer returned by underlying malloc. */
-  size_t nbytes;
+  /* Where the block comes from. The low bits (NNLC_BLOCK_KIND_MASK)
+   * tell the kind of block, the remaining bits are:
+   *  - NNLC_BLOCK_RUNTIME: the pointer returned by underlying malloc
+   *  - NNLC_BLOCK_SLAB: the struct slab_class the block belongs to
+   *  - NNLC_BLOCK_PAGES: the address returned by runtime alloc_pages
+   *  - NNLC_BLOCK_ALIGNED: the malloc() block this one is carved from
+   *  - NNLC_BLOCK_ARENA: the struct nnlc_arena it was allocated from */
+  void *mem;
+  size_t nbytes; /* usable size, see malloc_usable_size() */
   char data[0];
 };
 
+#define NNLC_BLOCK_RUNTIME 0
+#define NNLC_BLOCK_SLAB 1
+#define NNLC_BLOCK_PAGES 2
+#define NNLC_BLOCK_ALIGNED 3
+#define NNLC_BLOCK_ARENA 4
+#define NNLC_BLOCK_KIND_MASK ((uintptr_t)0x7)
+
 #define NNLC_ALIGNMENT_MASK (NNLC_MALLOC_ALIGNMENT - 1)
 
+/* Space reserved in front of the data of blocks we carve ourselves,
+ * for their malloc_block */
+#define NNLC_BLOCK_HEADER_SIZE \
+  (((sizeof(struct malloc_block) + NNLC_ALIGNMENT_MASK)) & ~NNLC_ALIGNMENT_MASK)
+
 /* Round the requested size up to include enough for alignment. */
 static inline intptr_t pad_for_alignment(intptr_t requested_size) {
   return requested_size + NNLC_MALLOC_ALIGNMENT - 1;
@@ -55,63 +90,841 @@ static struct malloc_block *get_malloc_block(void *p) {
   return (struct malloc_block*)p - 1;
 }
 
-void *malloc(size_t size) {
+static inline uintptr_t block_kind(const struct malloc_block *m) {
+  return (uintptr_t)m->mem & NNLC_BLOCK_KIND_MASK;
+}
+
+static inline void *block_origin(const struct malloc_block *m) {
+  return (void*)((uintptr_t)m->mem & ~NNLC_BLOCK_KIND_MASK);
+}
+
+static inline void *make_origin(void *origin, uintptr_t kind) {
+  return (void*)((uintptr_t)origin | kind);
+}
+
+/*
+ * Statistics
+ */
+#ifdef NNLC_MALLOC_STATS
+static struct {
+  size_t in_use;          /* usable bytes of the live blocks */
+  size_t peak_in_use;
+  size_t runtime_bytes;   /* obtained from runtime malloc */
+  size_t pages_bytes;     /* obtained from runtime alloc_pages */
+  size_t pages_blocks;    /* live blocks backed by pages */
+  size_t slab_free_bytes; /* usable bytes in the slab free lists */
+  uint64_t large_allocs;  /* not served by the slab allocator */
+  uint64_t runtime_mallocs, runtime_frees;
+  uint64_t runtime_alloc_pages, runtime_free_pages;
+} malloc_stats;
+
+static void stats_add_in_use(size_t nbytes) {
+  malloc_stats.in_use += nbytes;
+  if (malloc_stats.in_use > malloc_stats.peak_in_use)
+    malloc_stats.peak_in_use = malloc_stats.in_use;
+}
+
+#define MALLOC_STATS(statement) \
+  do {                          \
+    statement;                  \
+  } while (0)
+#else
+#define MALLOC_STATS(statement) \
+  do {                          \
+  } while (0)
+#endif
+
+/* Calls to the underlying runtime */
+static void *sys_malloc(size_t size) {
+  void *mem = __nnlc_internal_data.sysdeps->malloc(size);
+  MALLOC_STATS(++malloc_stats.runtime_mallocs;
+               if (mem) malloc_stats.runtime_bytes += size);
+  return mem;
+}
+
+static void sys_free(void *mem, size_t size) {
+  MALLOC_STATS(++malloc_stats.runtime_frees;
+               malloc_stats.runtime_bytes -= size);
+  (void)size;
+  __nnlc_internal_data.sysdeps->free(mem);
+}
+
+static void *sys_alloc_pages(size_t npages) {
+  void *p = __nnlc_internal_data.sysdeps->alloc_pages(npages);
+  MALLOC_STATS(++malloc_stats.runtime_alloc_pages;
+               if (p) malloc_stats.pages_bytes += npages * NNLC_PAGE_SIZE);
+  return p;
+}
+
+static void sys_free_pages(void *p, size_t npages) {
+  MALLOC_STATS(++malloc_stats.runtime_free_pages;
+               malloc_stats.pages_bytes -= npages * NNLC_PAGE_SIZE);
+  __nnlc_internal_data.sysdeps->free_pages(p, npages);
+}
+
+/*
+ * Size-class (slab) allocator.
+ *
+ * Classes are 16 bytes apart up to 128 bytes, then 4 classes per
+ * power of 2 up to NNLC_SLAB_MAX_SIZE. A slot is a malloc_block
+ * header followed by the class size. Slots are carved on demand from
+ * a NNLC_SLAB_CHUNK_SIZE chunk shared by all classes, and freed slots
+ * go to a per-class free list (the link is stored in the data
+ * area). Chunks are never given back to the runtime.
+ */
+#define NNLC_SLAB_MAX_SIZE 2048
+#define NNLC_SLAB_NUM_CLASSES 24
+#define NNLC_SLAB_CHUNK_SIZE (64 * 1024)
+
+struct slab_class {
+  void *free_list; /* data pointers of the free slots of this class */
+  size_t size;     /* bytes usable in each slot */
+#ifdef NNLC_MALLOC_STATS
+  uint64_t nallocs;
+#endif
+} __attribute__((aligned(8))); /* low bits of its address are a tag */
+
+static struct slab_class slab_classes[NNLC_SLAB_NUM_CLASSES] = {
+    {.size = 16},   {.size = 32},   {.size = 48},   {.size = 64},
+    {.size = 80},   {.size = 96},   {.size = 112},  {.size = 128},
+    {.size = 160},  {.size = 192},  {.size = 224},  {.size = 256},
+    {.size = 320},  {.size = 384},  {.size = 448},  {.size = 512},
+    {.size = 640},  {.size = 768},  {.size = 896},  {.size = 1024},
+    {.size = 1280}, {.size = 1536}, {.size = 1792}, {.size = 2048},
+};
+
+/* Unused part of the last chunk obtained from the runtime */
+static char *slab_chunk_next, *slab_chunk_end;
+
+/* Index in slab_classes of the smallest class holding 'size' bytes,
+ * 0 < size <= NNLC_SLAB_MAX_SIZE */
+static inline unsigned slab_class_index(size_t size) {
+  unsigned msb;
+
+  if (size <= 128) return (size - 1) >> 4;
+
+  /* 4 classes per power of 2: use the 2 bits below the MSB */
+  msb = (8 * sizeof(unsigned long) - 1) - __builtin_clzl(size - 1);
+  return 8 + (msb - 7) * 4 + (((size - 1) >> (msb - 2)) & 3);
+}
+
+/* Carve a new slot of the given class from the current chunk,
+ * getting a new chunk from the runtime when needed. Return the data
+ * pointer of the slot. */
+static void *slab_carve(struct slab_class *cls) {
+  const size_t slot_size = NNLC_BLOCK_HEADER_SIZE + cls->size;
+  void *p;
+
+  if ((size_t)(slab_chunk_end - slab_chunk_next) < slot_size) {
+    /* The tail of the previous chunk is lost: at most
+     * NNLC_SLAB_MAX_SIZE bytes out of NNLC_SLAB_CHUNK_SIZE */
+    char *chunk = sys_malloc(NNLC_SLAB_CHUNK_SIZE);
+    if (NULL == chunk) return NULL;
+    slab_chunk_end = chunk + NNLC_SLAB_CHUNK_SIZE;
+    slab_chunk_next = align_after(chunk, 0);
+  }
+
+  p = slab_chunk_next + NNLC_BLOCK_HEADER_SIZE;
+  slab_chunk_next += slot_size;
+  get_malloc_block(p)->mem = make_origin(cls, NNLC_BLOCK_SLAB);
+  get_malloc_block(p)->nbytes = cls->size;
+  return p;
+}
+
+static void *slab_malloc(size_t size) {
+  struct slab_class *cls = &slab_classes[slab_class_index(size)];
+  void *p = cls->free_list;
+
+  if (NULL != p) {
+    cls->free_list = *(void **)p; /* header still valid from slab_carve */
+    MALLOC_STATS(malloc_stats.slab_free_bytes -= cls->size);
+  } else if (NULL == (p = slab_carve(cls))) {
+    return NULL;
+  }
+
+  MALLOC_STATS(++cls->nallocs; stats_add_in_use(cls->size));
+  return p;
+}
+
+static void slab_free(struct slab_class *cls, void *p) {
+  MALLOC_STATS(malloc_stats.in_use -= cls->size;
+               malloc_stats.slab_free_bytes += cls->size);
+  *(void **)p = cls->free_list;
+  cls->free_list = p;
+}
+
+/*
+ * Page allocator, for large blocks.
+ *
+ * The data starts on the second page, so that it is page-aligned and
+ * the malloc_block header fits at the end of the first page. The
+ * number of pages to release is computed back from the header, so
+ * pages_count() must stay in sync with what is mapped.
+ */
+#define NNLC_PAGES_MIN_SIZE (128 * 1024)
+
+static inline size_t pages_count(size_t nbytes_from_base) {
+  return (nbytes_from_base + NNLC_PAGE_SIZE - 1) / NNLC_PAGE_SIZE;
+}
+
+static void *pages_malloc(size_t size) {
+  size_t npages;
+  char *base;
+  void *p;
+
+  if (size > (size_t)-1 - 2 * NNLC_PAGE_SIZE) return NULL; /* overflow */
+  npages = pages_count(size) + 1;
+
+  base = sys_alloc_pages(npages);
+  if (NULL == base) return NULL;
+
+  p = base + NNLC_PAGE_SIZE;
+  get_malloc_block(p)->mem = make_origin(base, NNLC_BLOCK_PAGES);
+  get_malloc_block(p)->nbytes = (npages - 1) * NNLC_PAGE_SIZE;
+  MALLOC_STATS(++malloc_stats.large_allocs; ++malloc_stats.pages_blocks;
+               stats_add_in_use(get_malloc_block(p)->nbytes));
+  return p;
+}
+
+static void pages_free(struct malloc_block *m) {
+  char *base = block_origin(m);
+  MALLOC_STATS(--malloc_stats.pages_blocks;
+               malloc_stats.in_use -= m->nbytes);
+  sys_free_pages(base, pages_count((char *)m->data - base + m->nbytes));
+}
+
+/* Give back to the runtime the pages after the first 'size' bytes of
+ * the block, 0 < size <= m->nbytes */
+static void pages_shrink(struct malloc_block *m, size_t size) {
+  char *base = block_origin(m);
+  const size_t offset = (char *)m->data - base;
+  const size_t npages = pages_count(offset + m->nbytes);
+  const size_t new_npages = pages_count(offset + size);
+
+  if (new_npages >= npages) return;
+
+  sys_free_pages(base + new_npages * NNLC_PAGE_SIZE, npages - new_npages);
+  MALLOC_STATS(malloc_stats.in_use -= m->nbytes);
+  m->nbytes = new_npages * NNLC_PAGE_SIZE - offset;
+  MALLOC_STATS(malloc_stats.in_use += m->nbytes);
+}
+
+/* Direct trampoline to the underlying runtime */
+static void *runtime_malloc(size_t size) {
   struct malloc_block *m;
   void *mem;
   size_t mem_size = pad_for_alignment(size) + sizeof(*m);
   void *p;
 
-  if (size <= 0) return NULL;
+  if (mem_size < size) return NULL; /* overflow */
 
-  mem = __nnlc_internal_data.sysdeps->malloc(mem_size);
+  mem = sys_malloc(mem_size);
   if (NULL == mem) return NULL;
+  assert(((uintptr_t)mem & NNLC_BLOCK_KIND_MASK) == 0);
 
   p = align_after(mem, sizeof(*m));
   m = get_malloc_block(p);
 
-  m->mem = mem;
-  m->nbytes = size;
+  m->mem = make_origin(mem, NNLC_BLOCK_RUNTIME);
+  m->nbytes = (char *)mem + mem_size - (char *)p;
+  MALLOC_STATS(++malloc_stats.large_allocs; stats_add_in_use(m->nbytes));
   return p;
 }
 
-void free(void *ptr) {
+/*
+ * Blocks allocated while an arena is in use (see
+ * nnlc_malloc_use_arena()): free() ignores them, they go away with
+ * the arena.
+ */
+static struct nnlc_arena *malloc_arena;
+
+static void *arena_malloc(size_t size) {
+  char *p;
+
+  if (size > (size_t)-1 - NNLC_BLOCK_HEADER_SIZE - NNLC_ALIGNMENT_MASK)
+    return NULL; /* overflow */
+
+  p = nnlc_arena_alloc(malloc_arena, NNLC_BLOCK_HEADER_SIZE + size);
+  if (NULL == p) return NULL;
+
+  p += NNLC_BLOCK_HEADER_SIZE;
+  get_malloc_block(p)->mem = make_origin(malloc_arena, NNLC_BLOCK_ARENA);
+  get_malloc_block(p)->nbytes = (size + NNLC_ALIGNMENT_MASK) & ~NNLC_ALIGNMENT_MASK;
+  return p;
+}
+
+struct nnlc_arena *nnlc_malloc_use_arena(struct nnlc_arena *arena) {
+  struct nnlc_arena *prev = malloc_arena;
+  malloc_arena = arena;
+  return prev;
+}
+
+static void *heap_malloc(size_t size) {
+  if (size <= 0) return NULL;
+
+  if (NULL != malloc_arena) return arena_malloc(size);
+
+  if (size <= NNLC_SLAB_MAX_SIZE) return slab_malloc(size);
+
+  if (size >= NNLC_PAGES_MIN_SIZE &&
+      NULL != __nnlc_internal_data.sysdeps->alloc_pages) {
+    void *p = pages_malloc(size);
+    if (NULL != p) return p;
+  }
+
+  return runtime_malloc(size);
+}
+
+static void heap_free(void *ptr) {
+  struct malloc_block *m;
+
   if (NULL == ptr) return;
 
-  __nnlc_internal_data.sysdeps->free(get_malloc_block(ptr)->mem);
+  m = get_malloc_block(ptr);
+  switch (block_kind(m)) {
+    case NNLC_BLOCK_SLAB:
+      slab_free(block_origin(m), ptr);
+      break;
+    case NNLC_BLOCK_PAGES:
+      pages_free(m);
+      break;
+    case NNLC_BLOCK_ALIGNED:
+      heap_free(block_origin(m));
+      break;
+    case NNLC_BLOCK_ARENA:
+      break;
+    default:
+      MALLOC_STATS(malloc_stats.in_use -= m->nbytes);
+      sys_free(block_origin(m),
+               (char *)ptr - (char *)block_origin(m) + m->nbytes);
+      break;
+  }
 }
 
-void *calloc(size_t num, size_t size) {
-  // Be careful to check for overflow.
-  size_t len = num * size;
-  if (size == 0 || num != len / size) {
-    return NULL;
+/*
+ * Aligned allocations.
+ */
+
+/* Page-backed block with data aligned on 'alignment', a power of 2 >
+ * NNLC_PAGE_SIZE: over-allocate, then give back the pages before and
+ * after the aligned data. */
+static void *pages_memalign(size_t alignment, size_t size) {
+  struct malloc_block *m;
+  char *p0, *p;
+  size_t nbytes;
+
+  if (size > (size_t)-1 - alignment) return NULL; /* overflow */
+
+  p0 = pages_malloc(size + alignment - NNLC_PAGE_SIZE);
+  if (NULL == p0) return NULL;
+
+  p = (char *)(((uintptr_t)p0 + alignment - 1) & ~(uintptr_t)(alignment - 1));
+  nbytes = get_malloc_block(p0)->nbytes - (p - p0);
+  if (p != p0) {
+    sys_free_pages(p0 - NNLC_PAGE_SIZE, (p - p0) / NNLC_PAGE_SIZE);
+    MALLOC_STATS(malloc_stats.in_use -= p - p0);
   }
-  void* buf = malloc(len);
-  memset(buf, 0, len);
-  return buf;
+
+  m = get_malloc_block(p);
+  m->mem = make_origin(p - NNLC_PAGE_SIZE, NNLC_BLOCK_PAGES);
+  m->nbytes = nbytes;
+  pages_shrink(m, size);
+  return p;
 }
 
-void *realloc(void *ptr, size_t size) {
+/* Block with data aligned on 'alignment', a power of 2 >
+ * NNLC_MALLOC_ALIGNMENT, carved from a malloc() block large enough
+ * for the data and its own malloc_block header. */
+static void *nested_memalign(size_t alignment, size_t size) {
+  struct malloc_block *m;
+  char *inner, *p;
+
+  if (size > (size_t)-1 - alignment) return NULL; /* overflow */
+
+  inner = heap_malloc(size + alignment);
+  if (NULL == inner) return NULL;
+
+  /* inner is aligned on NNLC_MALLOC_ALIGNMENT, so p <= inner + alignment */
+  p = (char *)(((uintptr_t)inner + sizeof(*m) + alignment - 1) &
+               ~(uintptr_t)(alignment - 1));
+
+  m = get_malloc_block(p);
+  m->mem = make_origin(inner, NNLC_BLOCK_ALIGNED);
+  m->nbytes = get_malloc_block(inner)->nbytes - (p - inner);
+  return p;
+}
+
+static void *heap_memalign(size_t alignment, size_t size) {
+  void *p;
+
+  if (size <= 0) return NULL;
+  if (alignment & (alignment - 1)) return NULL; /* not a power of 2 */
+
+  if (alignment <= NNLC_MALLOC_ALIGNMENT) return heap_malloc(size);
+
+  /* Page-aligned blocks, or large blocks for which a few pages more
+   * or less don't matter: no need to pad more than a page. */
+  if ((alignment >= NNLC_PAGE_SIZE || size >= NNLC_PAGES_MIN_SIZE) &&
+      NULL != __nnlc_internal_data.sysdeps->alloc_pages) {
+    if (alignment <= NNLC_PAGE_SIZE)
+      p = pages_malloc(size);
+    else
+      p = pages_memalign(alignment, size);
+    if (NULL != p) return p;
+  }
+
+  return nested_memalign(alignment, size);
+}
+
+#ifndef NNLC_DEBUG_HEAP /* the debug heap always moves blocks */
+
+/* Try to resize the block in place: return TRUE on success. When
+ * shrinking, may still return FALSE if moving the data to a smaller
+ * block would give a good deal of memory back. */
+static int realloc_in_place(struct malloc_block *m, size_t size) {
+  if (size > m->nbytes) return 0; /* no adjacent space we know of */
+
+  switch (block_kind(m)) {
+    case NNLC_BLOCK_PAGES:
+      if (size < NNLC_PAGES_MIN_SIZE) return 0;
+      pages_shrink(m, size);
+      return 1;
+    case NNLC_BLOCK_ARENA:
+      return 1; /* moving would not give anything back */
+    default:
+      /* slab blocks: keep small enough classes, runtime blocks:
+       * keep if at least half is used */
+      return (m->nbytes <= 128) || (size >= m->nbytes / 2);
+  }
+}
+
+static void *heap_realloc(void *ptr, size_t size) {
+  struct malloc_block *m;
   void *new_ptr;
   size_t prev_size;
 
   if (NULL == ptr)
-    return malloc(size); /* Ok if size <= 0: returns NULL */
+    return heap_malloc(size); /* Ok if size <= 0: returns NULL */
   else if (size <= 0) {
-    free(ptr);
+    heap_free(ptr);
     return NULL;
   }
 
   /* Invariants: ptr != NULL and size > 0 */
 
-  prev_size = get_malloc_block(ptr)->nbytes;
-  if (size <= prev_size) return ptr; /* no need to change anything */
+  m = get_malloc_block(ptr);
+  if (realloc_in_place(m, size)) return ptr;
+
+  prev_size = m->nbytes;
+  new_ptr = heap_malloc(size);
+  if (NULL == new_ptr) {
+    /* failing to shrink is harmless, failing to grow leaves ptr
+     * untouched */
+    return (size <= prev_size) ? ptr : NULL;
+  }
+
+  memcpy(new_ptr, ptr, (size < prev_size) ? size : prev_size);
+  heap_free(ptr);
+  return new_ptr;
+}
+
+#endif /* !NNLC_DEBUG_HEAP */
+
+static size_t heap_usable_size(void *ptr) {
+  if (NULL == ptr) return 0;
+
+  return get_malloc_block(ptr)->nbytes;
+}
+
+/*
+ * Public entry points
+ */
+#ifndef NNLC_DEBUG_HEAP
+
+void *malloc(size_t size) { return heap_malloc(size); }
+
+void free(void *ptr) { heap_free(ptr); }
+
+void *realloc(void *ptr, size_t size) { return heap_realloc(ptr, size); }
+
+void *memalign(size_t alignment, size_t size) {
+  return heap_memalign(alignment, size);
+}
+
+size_t malloc_usable_size(void *ptr) { return heap_usable_size(ptr); }
+
+int nnlc_malloc_check(FILE *stream) {
+  (void)stream; /* silence gcc warning */
+  return 0;
+}
+
+void __nnlc_malloc_finalize(void) {}
+
+#else /* NNLC_DEBUG_HEAP */
+
+/*
+ * Debug heap: each block gets a struct debug_block header and
+ * redzones on both sides, filled with NNLC_DEBUG_REDZONE_BYTE and
+ * checked when the block is freed. Fresh blocks are filled with
+ * NNLC_DEBUG_ALLOC_BYTE, freed blocks with NNLC_DEBUG_FREED_BYTE, and
+ * the most recently freed blocks (up to NNLC_DEBUG_QUARANTINE blocks
+ * or NNLC_DEBUG_QUARANTINE_BYTES) are kept aside to catch writes
+ * after free. Live blocks are linked together
+ * for the leak report printed by __nnlc_malloc_finalize().
+ *
+ * Blocks allocated from an arena are left alone (see arena_malloc()):
+ * the malloc_block header of such blocks is where a debug block has
+ * its front redzone, NNLC_DEBUG_REDZONE_BYTE does not look like an
+ * NNLC_BLOCK_ARENA tag.
+ */
+#define NNLC_DEBUG_REDZONE 16
+#define NNLC_DEBUG_REDZONE_BYTE 0xfd
+#define NNLC_DEBUG_ALLOC_BYTE 0xcd
+#define NNLC_DEBUG_FREED_BYTE 0xdd
+#define NNLC_DEBUG_QUARANTINE 256
+#define NNLC_DEBUG_QUARANTINE_BYTES (4 * 1024 * 1024)
+#define NNLC_DEBUG_MAGIC_LIVE 0x6e6e6c63
+#define NNLC_DEBUG_MAGIC_FREED 0x66726565
+
+struct debug_block {
+  struct debug_block *prev, *next; /* live blocks */
+  void *base;                      /* block returned by heap_malloc() */
+  size_t size;                     /* requested by the user */
+  unsigned long seq;               /* allocation number */
+  uint32_t magic;
+  unsigned char front_redzone[NNLC_DEBUG_REDZONE];
+} __attribute__((aligned(NNLC_MALLOC_ALIGNMENT)));
+
+/* The front redzone goes up to the user data, through the padding at
+ * the end of struct debug_block */
+#define NNLC_DEBUG_FRONT_REDZONE \
+  (sizeof(struct debug_block) - offsetof(struct debug_block, front_redzone))
+
+static struct debug_block *debug_live;
+static unsigned long debug_seq;
+/* ring of freed blocks, oldest first */
+static struct debug_block *debug_quarantine[NNLC_DEBUG_QUARANTINE];
+static unsigned debug_quarantine_first, debug_quarantine_count;
+static size_t debug_quarantine_bytes;
+
+static inline struct debug_block *get_debug_block(void *p) {
+  return (struct debug_block *)p - 1;
+}
+
+static inline int debug_is_arena_block(void *p) {
+  return block_kind(get_malloc_block(p)) == NNLC_BLOCK_ARENA;
+}
+
+static int debug_is_filled(const unsigned char *p, size_t n,
+                           unsigned char c) {
+  while (n-- > 0)
+    if (*p++ != c) return 0;
+  return 1;
+}
+
+static void debug_report(FILE *stream, const char *what,
+                         struct debug_block *d) {
+  if (stream == NULL) return;
+  fprintf(stream, "heap: %s: block %p of %lu bytes (allocation #%lu)\n",
+          what, (void *)(d + 1), (unsigned long)d->size, d->seq);
+}
+
+/* Return TRUE if the redzones of the block are intact, else report
+ * to stream (if not NULL) */
+static int debug_check_redzones(FILE *stream, struct debug_block *d) {
+  const unsigned char *back = (unsigned char *)(d + 1) + d->size;
+
+  if (!debug_is_filled(d->front_redzone, NNLC_DEBUG_FRONT_REDZONE,
+                       NNLC_DEBUG_REDZONE_BYTE)) {
+    debug_report(stream, "buffer underflow", d);
+    return 0;
+  }
+  if (!debug_is_filled(back, NNLC_DEBUG_REDZONE, NNLC_DEBUG_REDZONE_BYTE)) {
+    debug_report(stream, "buffer overflow", d);
+    return 0;
+  }
+  return 1;
+}
+
+static void *debug_alloc(size_t alignment, size_t size) {
+  const size_t offset = (sizeof(struct debug_block) + alignment - 1) &
+                        ~(alignment - 1);
+  struct debug_block *d;
+  char *base, *p;
+
+  if (size > (size_t)-1 - offset - NNLC_DEBUG_REDZONE)
+    return NULL; /* overflow */
+
+  if (alignment <= NNLC_MALLOC_ALIGNMENT)
+    base = heap_malloc(offset + size + NNLC_DEBUG_REDZONE);
+  else
+    base = heap_memalign(alignment, offset + size + NNLC_DEBUG_REDZONE);
+  if (NULL == base) return NULL;
+
+  p = base + offset;
+  d = get_debug_block(p);
+  d->base = base;
+  d->size = size;
+  d->seq = ++debug_seq;
+  d->magic = NNLC_DEBUG_MAGIC_LIVE;
+  memset(d->front_redzone, NNLC_DEBUG_REDZONE_BYTE, NNLC_DEBUG_FRONT_REDZONE);
+  memset(p, NNLC_DEBUG_ALLOC_BYTE, size);
+  memset(p + size, NNLC_DEBUG_REDZONE_BYTE, NNLC_DEBUG_REDZONE);
+
+  d->prev = NULL;
+  d->next = debug_live;
+  if (debug_live) debug_live->prev = d;
+  debug_live = d;
+  return p;
+}
+
+/* Really free the oldest block of the quarantine, checking nothing
+ * wrote to it while it was there */
+static void debug_release_oldest(void) {
+  struct debug_block *d = debug_quarantine[debug_quarantine_first];
+
+  debug_quarantine_first =
+      (debug_quarantine_first + 1) % NNLC_DEBUG_QUARANTINE;
+  --debug_quarantine_count;
+  debug_quarantine_bytes -= d->size;
+
+  if (!debug_is_filled((unsigned char *)(d + 1), d->size,
+                       NNLC_DEBUG_FREED_BYTE)) {
+    debug_report(stderr, "write after free", d);
+    abort();
+  }
+  if (!debug_check_redzones(stderr, d)) abort();
+
+  heap_free(d->base);
+}
+
+void *malloc(size_t size) {
+  if (size <= 0) return NULL;
+  if (NULL != malloc_arena) return heap_malloc(size);
+
+  return debug_alloc(NNLC_MALLOC_ALIGNMENT, size);
+}
+
+void free(void *ptr) {
+  struct debug_block *d;
 
-  /* Invariants: ptr != NULL and size > prev_size > 0 */
+  if (NULL == ptr || debug_is_arena_block(ptr)) return;
 
+  d = get_debug_block(ptr);
+  if (d->magic != NNLC_DEBUG_MAGIC_LIVE) {
+    fprintf(stderr, "heap: %s of %p\n",
+            (d->magic == NNLC_DEBUG_MAGIC_FREED) ? "double free"
+                                                 : "free of invalid pointer",
+            ptr);
+    abort();
+  }
+
+  /* not reported as a leak anymore, even if we abort below */
+  if (d->prev)
+    d->prev->next = d->next;
+  else
+    debug_live = d->next;
+  if (d->next) d->next->prev = d->prev;
+
+  if (!debug_check_redzones(stderr, d)) abort();
+
+  d->magic = NNLC_DEBUG_MAGIC_FREED;
+  memset(ptr, NNLC_DEBUG_FREED_BYTE, d->size);
+
+  while (debug_quarantine_count >= NNLC_DEBUG_QUARANTINE ||
+         (debug_quarantine_count > 0 &&
+          debug_quarantine_bytes + d->size > NNLC_DEBUG_QUARANTINE_BYTES))
+    debug_release_oldest();
+
+  debug_quarantine[(debug_quarantine_first + debug_quarantine_count) %
+                   NNLC_DEBUG_QUARANTINE] = d;
+  ++debug_quarantine_count;
+  debug_quarantine_bytes += d->size;
+}
+
+size_t malloc_usable_size(void *ptr) {
+  if (NULL == ptr) return 0;
+  if (debug_is_arena_block(ptr)) return heap_usable_size(ptr);
+
+  return get_debug_block(ptr)->size;
+}
+
+/* Always move the data, so that users of stale pointers hit the
+ * quarantine */
+void *realloc(void *ptr, size_t size) {
+  size_t prev_size;
+  void *new_ptr;
+
+  if (NULL == ptr)
+    return malloc(size);
+  else if (size <= 0) {
+    free(ptr);
+    return NULL;
+  }
+
+  prev_size = malloc_usable_size(ptr);
   new_ptr = malloc(size);
-  if (NULL != new_ptr) memcpy(new_ptr, ptr, prev_size);
+  if (NULL == new_ptr) return NULL;
 
+  memcpy(new_ptr, ptr, (size < prev_size) ? size : prev_size);
   free(ptr);
   return new_ptr;
 }
+
+void *memalign(size_t alignment, size_t size) {
+  if (size <= 0) return NULL;
+  if (alignment & (alignment - 1)) return NULL; /* not a power of 2 */
+  if (NULL != malloc_arena) return heap_memalign(alignment, size);
+
+  if (alignment < NNLC_MALLOC_ALIGNMENT) alignment = NNLC_MALLOC_ALIGNMENT;
+  return debug_alloc(alignment, size);
+}
+
+int nnlc_malloc_check(FILE *stream) {
+  struct debug_block *d;
+  int ncorrupted = 0;
+
+  for (d = debug_live; d != NULL; d = d->next)
+    if (!debug_check_redzones(stream, d)) ++ncorrupted;
+  return ncorrupted;
+}
+
+/* Check the blocks still in use and print the leak report */
+void __nnlc_malloc_finalize(void) {
+  struct debug_block *d;
+  unsigned long nblocks = 0;
+  size_t nbytes = 0;
+  unsigned i;
+
+  for (d = debug_live; d != NULL; d = d->next) {
+    debug_check_redzones(stderr, d);
+    if (nblocks++ < 32) debug_report(stderr, "leak", d);
+    nbytes += d->size;
+  }
+
+  for (i = 0; i < debug_quarantine_count; ++i) {
+    d = debug_quarantine[(debug_quarantine_first + i) % NNLC_DEBUG_QUARANTINE];
+    if (!debug_is_filled((unsigned char *)(d + 1), d->size,
+                              NNLC_DEBUG_FREED_BYTE))
+      debug_report(stderr, "write after free", d);
+  }
+
+  if (nblocks > 0)
+    fprintf(stderr, "heap: %lu bytes leaked in %lu blocks\n",
+            (unsigned long)nbytes, nblocks);
+}
+
+#endif /* NNLC_DEBUG_HEAP */
+
+void *aligned_alloc(size_t alignment, size_t size) {
+  return memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+  void *p;
+
+  if (alignment == 0 || (alignment % sizeof(void *)) ||
+      (alignment & (alignment - 1)))
+    return EINVAL;
+
+  p = memalign(alignment, size);
+  if (NULL == p && size > 0) return ENOMEM;
+
+  *memptr = p;
+  return 0;
+}
+
+void *valloc(size_t size) { return memalign(NNLC_PAGE_SIZE, size); }
+
+void *calloc(size_t num, size_t size) {
+  size_t len;
+  void *p;
+
+  /* Be careful to check for overflow. */
+  if (size == 0 || num > (size_t)-1 / size) return NULL;
+  len = num * size;
+
+#ifndef NNLC_DEBUG_HEAP
+  /* Large blocks get fresh pages from the runtime: no need to clear
+   * them when the runtime already did */
+  if (len >= NNLC_PAGES_MIN_SIZE && NULL == malloc_arena &&
+      NULL != __nnlc_internal_data.sysdeps->alloc_pages &&
+      __nnlc_internal_data.sysdeps->alloc_pages_zeroed) {
+    p = pages_malloc(len);
+    if (NULL != p) return p;
+  }
+#endif
+
+  p = malloc(len);
+  if (NULL != p) memset(p, 0, len);
+  return p;
+}
+
+struct mallinfo2 mallinfo2(void) {
+  struct mallinfo2 mi;
+
+  memset(&mi, 0, sizeof(mi));
+#ifdef NNLC_MALLOC_STATS
+  mi.arena = malloc_stats.runtime_bytes;
+  mi.hblks = malloc_stats.pages_blocks;
+  mi.hblkhd = malloc_stats.pages_bytes;
+  mi.usmblks = malloc_stats.peak_in_use;
+  mi.uordblks = malloc_stats.in_use;
+  mi.fordblks =
+      malloc_stats.slab_free_bytes + (slab_chunk_end - slab_chunk_next);
+#endif
+  return mi;
+}
+
+struct mallinfo mallinfo(void) {
+  const struct mallinfo2 mi2 = mallinfo2();
+  struct mallinfo mi;
+
+  mi.arena = mi2.arena;
+  mi.ordblks = mi2.ordblks;
+  mi.smblks = mi2.smblks;
+  mi.hblks = mi2.hblks;
+  mi.hblkhd = mi2.hblkhd;
+  mi.usmblks = mi2.usmblks;
+  mi.fsmblks = mi2.fsmblks;
+  mi.uordblks = mi2.uordblks;
+  mi.fordblks = mi2.fordblks;
+  mi.keepcost = mi2.keepcost;
+  return mi;
+}
+
+void nnlc_malloc_stats(FILE *stream) {
+#ifdef NNLC_MALLOC_STATS
+  unsigned i;
+
+  fprintf(stream, "malloc: %lu bytes in use, peak %lu\n",
+          (unsigned long)malloc_stats.in_use,
+          (unsigned long)malloc_stats.peak_in_use);
+  fprintf(stream,
+          "malloc: %lu bytes from runtime malloc, %lu bytes from "
+          "runtime alloc_pages (%lu blocks)\n",
+          (unsigned long)malloc_stats.runtime_bytes,
+          (unsigned long)malloc_stats.pages_bytes,
+          (unsigned long)malloc_stats.pages_blocks);
+  fprintf(stream, "malloc: %lu bytes in free lists\n",
+          (unsigned long)malloc_stats.slab_free_bytes);
+  fprintf(stream,
+          "malloc: runtime calls: %llu malloc, %llu free, %llu alloc_pages, "
+          "%llu free_pages\n",
+          (unsigned long long)malloc_stats.runtime_mallocs,
+          (unsigned long long)malloc_stats.runtime_frees,
+          (unsigned long long)malloc_stats.runtime_alloc_pages,
+          (unsigned long long)malloc_stats.runtime_free_pages);
+  for (i = 0; i < NNLC_SLAB_NUM_CLASSES; ++i) {
+    if (slab_classes[i].nallocs)
+      fprintf(stream, "malloc: <= %4lu bytes: %llu allocations\n",
+              (unsigned long)slab_classes[i].size,
+              (unsigned long long)slab_classes[i].nallocs);
+  }
+  fprintf(stream, "malloc:  > %4lu bytes: %llu allocations\n",
+          (unsigned long)NNLC_SLAB_MAX_SIZE,
+          (unsigned long long)malloc_stats.large_allocs);
+#else
+  fputs("malloc: statistics not compiled in (NNLC_MALLOC_STATS)\n", stream);
+#endif
+}
@@ -16,6 +16,7 @@
  * Implementation of stdio.h functions.
  */
 
+#include <errno.h>
 #include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
@@ -23,7 +24,6 @@
 #include <stdio.h>
 
 #include "third_party/nanolibc/c/libc_internals.h"
-#include "third_party/tinyprintf/tinyprintf.h"
 
 FILE *stdin = &__nnlc_internal_data.libc_stdin;
 FILE *stdout = &__nnlc_internal_data.libc_stdout;
@@ -34,111 +34,932 @@ inline static int _is_valid_FILE(FILE *stream) {
   return ((stream != NULL) && (stream->magic == _NNLC_STDIO_MAGIC));
 }
 
+/* Streams from fopen(), fmemopen() and open_memstream(), for
+ * fflush(NULL) */
+static FILE *open_streams;
+
+/* Forget the input read ahead, moving the file position back to what
+ * the caller has consumed */
+static void drop_input(FILE *stream) {
+  const size_t ahead = stream->in_len - stream->in_pos;
+
+  if (ahead > 0 && stream->handle >= 0)
+    __nnlc_internal_data.sysdeps->file_seek(stream->handle, -(int64_t)ahead,
+                                            SEEK_CUR);
+  stream->in_pos = 0;
+  stream->in_len = 0;
+}
+
+/* returns TRUE if param 'stream' is a valid FILE* open for writing,
+ * after dropping its input */
+static int begin_write(FILE *stream) {
+  if (!_is_valid_FILE(stream)) return 0;
+  if (stream->handle < 0) return stream->write != NULL || stream->mem != NULL;
+  if (!(stream->flags & _NNLC_F_WRITE)) return 0;
+  if (stream->in_len > 0) drop_input(stream);
+  return 1;
+}
+
+/*
+ * Memory streams: the output reaching the stream is copied to buf,
+ * which grows for open_memstream()
+ */
+struct _mem_stream {
+  struct _FILE_DESCR file;
+  char *buf;
+  size_t size; /* of buf */
+  size_t pos;  /* where the next write goes */
+  size_t end;  /* end of the data */
+  int owned;   /* buf was allocated by fmemopen() */
+  char **bufp; /* open_memstream() */
+  size_t *sizep;
+};
+
+#define MEMSTREAM_MIN_SIZE 256
+
+/* Room for n more bytes and the NUL in an open_memstream() buffer.
+ * Returns 0 or -1 */
+static int mem_reserve(struct _mem_stream *m, size_t n) {
+  size_t need, size;
+  char *buf;
+
+  if (__builtin_add_overflow(m->pos, n, &need) || need == (size_t)-1)
+    return -1;
+  if (++need <= m->size) return 0;
+
+  size = (m->size > MEMSTREAM_MIN_SIZE) ? m->size : MEMSTREAM_MIN_SIZE;
+  while (size < need) size = (size > (size_t)-1 / 2) ? need : 2 * size;
+  buf = realloc(m->buf, size);
+  if (buf == NULL) return -1;
+  m->buf = buf;
+  m->size = size;
+  return 0;
+}
+
+static size_t mem_writev(struct _mem_stream *m, const struct nnlc_iovec *iov,
+                         int iovcnt) {
+  size_t total = 0;
+  int i;
+
+  for (i = 0; i < iovcnt; ++i) {
+    size_t n = iov[i].iov_len;
+
+    if (m->bufp != NULL) {
+      if (mem_reserve(m, n)) break;
+    } else if (n > m->size - m->pos) {
+      n = m->size - m->pos;
+    }
+    memcpy(m->buf + m->pos, iov[i].iov_base, n);
+    m->pos += n;
+    total += n;
+    if (n < iov[i].iov_len) break;
+  }
+
+  if (m->pos > m->end) {
+    m->end = m->pos;
+    if (m->end < m->size) m->buf[m->end] = '\0';
+  }
+  if (m->bufp != NULL) {
+    *m->bufp = m->buf;
+    *m->sizep = m->end;
+  }
+  if (total == 0 && iovcnt > 0) errno = (m->bufp != NULL) ? ENOMEM : ENOSPC;
+  return total;
+}
+
+/* Most pieces passed to stream_writev() at once */
+#define STREAM_IOV_MAX 2
+
+/* Hand the pieces over to the runtime, resuming after partial
+ * writes. Updates iov, returns the number of bytes written */
+static size_t write_iov(FILE *stream, struct nnlc_iovec *iov, int iovcnt) {
+  size_t total = 0;
+
+  if (stream->mem != NULL) return mem_writev(stream->mem, iov, iovcnt);
+
+  while (iovcnt > 0) {
+    ssize_t written;
+
+    if (iov->iov_len == 0) {
+      ++iov;
+      --iovcnt;
+      continue;
+    }
+
+    if (stream->handle >= 0) {
+      /* only when writing: flushing nothing keeps the read position */
+      if (stream->flags & _NNLC_F_APPEND)
+        __nnlc_internal_data.sysdeps->file_seek(stream->handle, 0, SEEK_END);
+      written = __nnlc_internal_data.sysdeps->file_write(
+          stream->handle, iov->iov_base, iov->iov_len);
+    } else if (stream->writev != NULL)
+      written = stream->writev(iov, iovcnt);
+    else
+      written = stream->write(iov->iov_base, iov->iov_len);
+    if (written <= 0) {
+      stream->flags |= _NNLC_F_ERR;
+      if (written < 0 && stream->handle >= 0) errno = -written;
+      break;
+    }
+    total += written;
+
+    for (; iovcnt > 0 && (size_t)written >= iov->iov_len; ++iov, --iovcnt)
+      written -= iov->iov_len;
+    if (iovcnt > 0) {
+      iov->iov_base = (const char *)iov->iov_base + written;
+      iov->iov_len -= written;
+    }
+  }
+
+  return total;
+}
+
+/* Hand the buffered output over to the runtime. Returns 0 or EOF */
+static int flush_buf(FILE *stream) {
+  struct nnlc_iovec iov;
+
+  iov.iov_base = stream->buf;
+  iov.iov_len = stream->buf_used;
+  stream->buf_used = 0;
+  return (write_iov(stream, &iov, 1) == iov.iov_len) ? 0 : EOF;
+}
+
+/* Returns the number of bytes of the pieces accepted by the
+ * stream. What does not fit in the buffer is written in a single
+ * operation together with the buffered output. */
+static size_t stream_writev(FILE *stream, const struct nnlc_iovec *iov,
+                            int iovcnt) {
+  struct nnlc_iovec all[1 + STREAM_IOV_MAX];
+  size_t total = 0, pending, written;
+  int i, newline = 0;
+
+  for (i = 0; i < iovcnt; ++i) total += iov[i].iov_len;
+  if (total == 0) return 0;
+
+  pending = stream->buf_used; /* output before the pieces */
+  all[0].iov_base = stream->buf;
+  if (total > stream->buf_size - pending) { /* always for _IONBF */
+    all[0].iov_len = pending;
+    for (i = 0; i < iovcnt; ++i) all[i + 1] = iov[i];
+    stream->buf_used = 0;
+    written = write_iov(stream, all, iovcnt + 1);
+  } else {
+    for (i = 0; i < iovcnt; ++i) {
+      memcpy(stream->buf + stream->buf_used, iov[i].iov_base,
+             iov[i].iov_len);
+      stream->buf_used += iov[i].iov_len;
+      if (stream->mode == _IOLBF &&
+          memchr(iov[i].iov_base, '\n', iov[i].iov_len) != NULL)
+        newline = 1;
+    }
+    if (!newline) return total;
+
+    all[0].iov_len = stream->buf_used;
+    stream->buf_used = 0;
+    written = write_iov(stream, all, 1);
+  }
+
+  return (written > pending) ? written - pending : 0;
+}
+
+static size_t stream_write(FILE *stream, const void *p, size_t n) {
+  struct nnlc_iovec iov;
+
+  iov.iov_base = p;
+  iov.iov_len = n;
+  return stream_writev(stream, &iov, 1);
+}
+
+/* The common case is a single store */
+static inline int stream_putc(FILE *stream, unsigned char c) {
+  if (stream->buf_used < stream->buf_size) {
+    stream->buf[stream->buf_used++] = c;
+    if (c == '\n' && stream->mode == _IOLBF && flush_buf(stream))
+      return EOF;
+    return c;
+  }
+  return (stream_write(stream, &c, 1) == 1) ? c : EOF;
+}
+
 int fputc(int c, FILE *stream) {
-  const unsigned char uc = c; /* according to man */
-  if (!_is_valid_FILE(stream) || !stream->write) return EOF;
-  if (1 != stream->write(&uc, 1)) return EOF;
-  return uc; /* according to man */
+  if (!begin_write(stream)) return EOF;
+  return stream_putc(stream, c); /* unsigned char, according to man */
 }
 
 int fputs(const char *s, FILE *stream) {
   size_t len;
-  if (!_is_valid_FILE(stream) || !stream->write) return EOF;
+  if (!begin_write(stream)) return EOF;
   len = strlen(s);
-  if (stream->write(s, len) != (ssize_t)len) return EOF;
+  if (stream_write(stream, s, len) != len) return EOF;
   return 1;
 }
 
 int putc(int c, FILE *stream) { return fputc(c, stream); }
 
-int putchar(int c) {
-  const unsigned char uc = c; /* according to man */
-  if (1 != stdout->write(&uc, 1)) return EOF;
-  return uc; /* according to man */
-}
+int putchar(int c) { return fputc(c, stdout); }
 
 int puts(const char *s) {
-  const size_t len = strlen(s);
-  if (stdout->write(s, len) != (ssize_t)len) return EOF;
-  if (1 != stdout->write("\n", 1)) return EOF;
+  struct nnlc_iovec iov[2];
+
+  if (!begin_write(stdout)) return EOF;
+  iov[0].iov_base = s;
+  iov[0].iov_len = strlen(s);
+  iov[1].iov_base = "\n";
+  iov[1].iov_len = 1;
+  if (stream_writev(stdout, iov, 2) != iov[0].iov_len + 1) return EOF;
   return 1;
 }
 
+/* Elements are written together, the count of those written in full
+ * is returned */
 size_t fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream) {
-  size_t i;
-  if (!_is_valid_FILE(stream) || !stream->write) return 0;
-  for (i = 0; i < nmemb; ++i) {
-    const void *p = ptr + (i * size);
-    if (stream->write(p, size) != (ssize_t)size) break;
+  size_t total;
+  if (!begin_write(stream)) return 0;
+  if (size == 0 || nmemb == 0) return 0;
+  if (__builtin_mul_overflow(size, nmemb, &total)) return 0;
+  return stream_write(stream, ptr, total) / size;
+}
+
+int setvbuf(FILE *stream, char *buf, int mode, size_t size) {
+  int owned = 0;
+
+  if (!_is_valid_FILE(stream)) return EOF;
+  if (mode != _IOFBF && mode != _IOLBF && mode != _IONBF) return EOF;
+  if (flush_buf(stream)) return EOF;
+  drop_input(stream);
+
+  if (mode == _IONBF) {
+    buf = NULL;
+    size = 0;
+  } else if (buf == NULL) {
+    if (size == 0) size = BUFSIZ;
+    buf = malloc(size);
+    if (buf == NULL) return EOF;
+    owned = 1;
+  } else if (size == 0) {
+    return EOF;
   }
-  return i;
+
+  if (stream->buf_owned) free(stream->buf);
+  stream->mode = mode;
+  stream->buf_owned = owned;
+  stream->buf = buf;
+  stream->buf_size = size;
+  return 0;
+}
+
+void setbuf(FILE *stream, char *buf) {
+  setvbuf(stream, buf, (buf != NULL) ? _IOFBF : _IONBF, BUFSIZ);
 }
 
 int fflush(FILE *stream) {
-  if (!_is_valid_FILE(stream)) return -1;
+  if (stream == NULL) {
+    int rc = fflush(&__nnlc_internal_data.libc_stdout);
+    rc |= fflush(&__nnlc_internal_data.libc_stderr);
+    for (stream = open_streams; stream != NULL; stream = stream->next_open)
+      rc |= fflush(stream);
+    return rc ? EOF : 0;
+  }
+
+  if (!_is_valid_FILE(stream)) return EOF;
+  return flush_buf(stream);
+}
+
+/* A new unbuffered stream, with neither write() nor handle */
+static void stream_open(FILE *stream) {
+  memset(stream, 0, sizeof(*stream));
+  stream->magic = _NNLC_STDIO_MAGIC;
+  stream->handle = -1;
+  stream->mode = _IONBF;
+  stream->next_open = open_streams;
+  open_streams = stream;
+}
+
+static FILE *mem_open(char *buf, size_t size, size_t pos) {
+  struct _mem_stream *m = malloc(sizeof(*m));
+
+  if (m == NULL) return NULL;
+  /* unbuffered: copying to memory is what buffering does */
+  stream_open(&m->file);
+  m->file.mem = m;
+  m->buf = buf;
+  m->size = size;
+  m->pos = pos;
+  m->end = pos;
+  m->owned = 0;
+  m->bufp = NULL;
+  m->sizep = NULL;
+  return &m->file;
+}
+
+FILE *fmemopen(void *buf, size_t size, const char *mode) {
+  FILE *stream;
+  size_t pos = 0;
+  int owned = 0;
+
+  if (size == 0 || mode == NULL ||
+      (mode[0] != 'w' && mode[0] != 'a' &&
+       !(mode[0] == 'r' && strchr(mode, '+') != NULL))) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  if (buf == NULL) {
+    buf = calloc(1, size);
+    if (buf == NULL) return NULL;
+    owned = 1;
+  } else if (mode[0] == 'w') {
+    *(char *)buf = '\0';
+  } else if (mode[0] == 'a') {
+    pos = strnlen(buf, size);
+  }
+
+  stream = mem_open(buf, size, pos);
+  if (stream == NULL) {
+    if (owned) free(buf);
+    return NULL;
+  }
+  stream->mem->owned = owned;
+  return stream;
+}
+
+FILE *open_memstream(char **ptr, size_t *sizeloc) {
+  FILE *stream;
+  char *buf;
+
+  if (ptr == NULL || sizeloc == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  buf = malloc(MEMSTREAM_MIN_SIZE);
+  if (buf == NULL) return NULL;
+  stream = mem_open(buf, MEMSTREAM_MIN_SIZE, 0);
+  if (stream == NULL) {
+    free(buf);
+    return NULL;
+  }
+
+  buf[0] = '\0';
+  stream->mem->bufp = ptr;
+  stream->mem->sizep = sizeloc;
+  *ptr = buf;
+  *sizeloc = 0;
+  return stream;
+}
+
+/*
+ * Files, from the file system hooks of the runtime
+ */
+FILE *fopen(const char *path, const char *mode) {
+  int flags, oflags;
+  intptr_t handle;
+  FILE *stream;
+
+  switch (mode[0]) {
+    case 'r':
+      flags = _NNLC_F_READ;
+      oflags = NNLC_FILE_READ;
+      break;
+    case 'w':
+      flags = _NNLC_F_WRITE;
+      oflags = NNLC_FILE_WRITE | NNLC_FILE_CREATE | NNLC_FILE_TRUNC;
+      break;
+    case 'a':
+      flags = _NNLC_F_WRITE | _NNLC_F_APPEND;
+      oflags = NNLC_FILE_WRITE | NNLC_FILE_CREATE;
+      break;
+    default:
+      errno = EINVAL;
+      return NULL;
+  }
+  if (strchr(mode, '+') != NULL) {
+    flags |= _NNLC_F_READ | _NNLC_F_WRITE;
+    oflags |= NNLC_FILE_READ | NNLC_FILE_WRITE;
+  }
+
+  if (__nnlc_internal_data.sysdeps->file_open == NULL) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  stream = malloc(sizeof(*stream));
+  if (stream == NULL) return NULL;
+  handle = __nnlc_internal_data.sysdeps->file_open(path, oflags);
+  if (handle < 0) {
+    errno = -handle;
+    free(stream);
+    return NULL;
+  }
+
+  stream_open(stream);
+  stream->handle = handle;
+  stream->flags = flags;
+  stream->buf = malloc(NNLC_FILE_BUF_SIZE);
+  if (stream->buf != NULL) { /* or unbuffered */
+    stream->mode = _IOFBF;
+    stream->buf_owned = 1;
+    stream->buf_size = NNLC_FILE_BUF_SIZE;
+  }
+  return stream;
+}
+
+int remove(const char *path) {
+  int rc = -ENOENT;
+
+  if (__nnlc_internal_data.sysdeps->file_remove != NULL)
+    rc = __nnlc_internal_data.sysdeps->file_remove(path);
+  if (rc < 0) {
+    errno = -rc;
+    return -1;
+  }
+  return 0;
+}
+
+/* Returns TRUE if param 'stream' is a valid FILE* open for reading,
+ * after flushing its output */
+static int begin_read(FILE *stream) {
+  if (!_is_valid_FILE(stream) || !(stream->flags & _NNLC_F_READ)) return 0;
+  if (stream->buf_used > 0 && flush_buf(stream)) return 0;
+  return 1;
+}
+
+/* Read from the runtime, sets the EOF and error flags */
+static size_t read_raw(FILE *stream, void *p, size_t n) {
+  ssize_t got;
+
+  if (stream->handle >= 0) {
+    got = __nnlc_internal_data.sysdeps->file_read(stream->handle, p, n);
+  } else {
+    fflush(stdout); /* the prompt comes before the answer */
+    got = stream->read(p, n);
+  }
+
+  if (got > 0) return got;
+  if (got == 0) {
+    stream->flags |= _NNLC_F_EOF;
+  } else {
+    stream->flags |= _NNLC_F_ERR;
+    errno = -got;
+  }
+  return 0;
+}
+
+/* The input buffer: buf, or in_byte for unbuffered streams */
+static inline char *in_buf(FILE *stream) {
+  return (stream->buf_size > 0) ? stream->buf : &stream->in_byte;
+}
+
+/* Read ahead into the empty input buffer. Returns 0 at EOF or on
+ * errors */
+static int fill_input(FILE *stream) {
+  stream->in_pos = 0;
+  stream->in_len = read_raw(stream, in_buf(stream),
+                            stream->buf_size ? stream->buf_size : 1);
+  return stream->in_len > 0;
+}
+
+/* Reads larger than the buffer go straight to the caller's memory */
+size_t fread(void *ptr, size_t size, size_t nmemb, FILE *stream) {
+  size_t total, got = 0;
+
+  if (size == 0 || nmemb == 0) return 0;
+  if (__builtin_mul_overflow(size, nmemb, &total)) return 0;
+  if (!begin_read(stream)) return 0;
+
+  while (got < total) {
+    const size_t avail = stream->in_len - stream->in_pos;
+
+    if (avail > 0) {
+      const size_t n = (avail < total - got) ? avail : total - got;
+      memcpy((char *)ptr + got, in_buf(stream) + stream->in_pos, n);
+      stream->in_pos += n;
+      got += n;
+    } else if (total - got >= stream->buf_size) {
+      const size_t n = read_raw(stream, (char *)ptr + got, total - got);
+      if (n == 0) break;
+      got += n;
+    } else if (!fill_input(stream)) {
+      break;
+    }
+  }
+
+  return got / size;
+}
+
+int fgetc(FILE *stream) {
+  if (!begin_read(stream)) return EOF;
+  if (stream->in_pos == stream->in_len && !fill_input(stream)) return EOF;
+  return (unsigned char)in_buf(stream)[stream->in_pos++];
+}
+
+int getc(FILE *stream) { return fgetc(stream); }
+
+int getchar(void) { return fgetc(stdin); }
+
+char *fgets(char *s, int size, FILE *stream) {
+  size_t n = 0;
+
+  if (size <= 0 || !begin_read(stream)) return NULL;
+
+  while (n < (size_t)size - 1) {
+    const char *in, *nl;
+    size_t k;
+
+    if (stream->in_pos == stream->in_len && !fill_input(stream)) break;
+    in = in_buf(stream) + stream->in_pos;
+    k = stream->in_len - stream->in_pos;
+    if (k > (size_t)size - 1 - n) k = (size_t)size - 1 - n;
+    nl = memchr(in, '\n', k);
+    if (nl != NULL) k = nl - in + 1;
+    memcpy(s + n, in, k);
+    stream->in_pos += k;
+    n += k;
+    if (nl != NULL) break;
+  }
+
+  if (n == 0) return NULL;
+  s[n] = '\0';
+  return s;
+}
+
+/* Room for size bytes in the getline() buffer. Returns 0 or -1 */
+static int line_reserve(char **lineptr, size_t *n, size_t size) {
+  size_t new_size = (*n > 120) ? *n : 120;
+  char *p;
+
+  if (*lineptr != NULL && size <= *n) return 0;
+  while (new_size < size)
+    new_size = (new_size > (size_t)-1 / 2) ? size : 2 * new_size;
+  p = realloc(*lineptr, new_size);
+  if (p == NULL) return -1;
+  *lineptr = p;
+  *n = new_size;
+  return 0;
+}
+
+ssize_t getdelim(char **lineptr, size_t *n, int delim, FILE *stream) {
+  size_t len = 0;
+
+  if (lineptr == NULL || n == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (!begin_read(stream)) {
+    errno = EBADF;
+    return -1;
+  }
+
+  for (;;) {
+    const char *in, *end;
+    size_t k;
+
+    if (stream->in_pos == stream->in_len && !fill_input(stream)) break;
+    in = in_buf(stream) + stream->in_pos;
+    k = stream->in_len - stream->in_pos;
+    end = memchr(in, delim, k);
+    if (end != NULL) k = end - in + 1;
+    if (line_reserve(lineptr, n, len + k + 1)) return -1;
+    memcpy(*lineptr + len, in, k);
+    stream->in_pos += k;
+    len += k;
+    if (end != NULL) break;
+  }
+
+  if (len == 0) return -1;
+  (*lineptr)[len] = '\0';
+  return len;
+}
+
+ssize_t getline(char **lineptr, size_t *n, FILE *stream) {
+  return getdelim(lineptr, n, '\n', stream);
+}
+
+int fseek(FILE *stream, long offset, int whence) {
+  int64_t pos;
+
+  if (!_is_valid_FILE(stream)) {
+    errno = EBADF;
+    return -1;
+  }
+  if (whence != SEEK_SET && whence != SEEK_CUR && whence != SEEK_END) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (flush_buf(stream)) return -1;
+
+  if (stream->mem != NULL) {
+    struct _mem_stream *m = stream->mem;
+    pos = offset + ((whence == SEEK_SET) ? 0
+                    : (whence == SEEK_CUR) ? (int64_t)m->pos
+                                           : (int64_t)m->end);
+    if (pos < 0 || (uint64_t)pos > m->end) {
+      errno = EINVAL;
+      return -1;
+    }
+    m->pos = pos;
+    return 0;
+  }
+
+  if (stream->handle < 0) {
+    errno = EBADF;
+    return -1;
+  }
+  if (whence == SEEK_CUR)
+    offset -= stream->in_len - stream->in_pos; /* read ahead */
+  stream->in_pos = 0;
+  stream->in_len = 0;
+  pos =
+      __nnlc_internal_data.sysdeps->file_seek(stream->handle, offset, whence);
+  if (pos < 0) {
+    errno = -pos;
+    return -1;
+  }
+  stream->flags &= ~_NNLC_F_EOF;
+  return 0;
+}
+
+long ftell(FILE *stream) {
+  int64_t pos;
+
+  if (!_is_valid_FILE(stream)) {
+    errno = EBADF;
+    return -1;
+  }
+  if (stream->mem != NULL) return stream->mem->pos + stream->buf_used;
+  if (stream->handle < 0) {
+    errno = EBADF;
+    return -1;
+  }
+
+  pos = __nnlc_internal_data.sysdeps->file_seek(stream->handle, 0, SEEK_CUR);
+  if (pos < 0) {
+    errno = -pos;
+    return -1;
+  }
+  return pos + stream->buf_used - (stream->in_len - stream->in_pos);
+}
+
+void rewind(FILE *stream) {
+  if (fseek(stream, 0, SEEK_SET) == 0) stream->flags &= ~_NNLC_F_ERR;
+}
+
+int feof(FILE *stream) {
+  return _is_valid_FILE(stream) && (stream->flags & _NNLC_F_EOF);
+}
+
+int ferror(FILE *stream) {
+  return _is_valid_FILE(stream) && (stream->flags & _NNLC_F_ERR);
+}
+
+void clearerr(FILE *stream) {
+  if (_is_valid_FILE(stream)) stream->flags &= ~(_NNLC_F_EOF | _NNLC_F_ERR);
+}
+
+/*
+ * Whole files, mapped by the runtime or read at once
+ */
+static const char empty_file[1];
+
+/* Memory for a file of size bytes: pages if the runtime has them */
+static void *map_alloc(size_t size) {
+  if (__nnlc_internal_data.sysdeps->alloc_pages == NULL) return malloc(size);
+  return __nnlc_internal_data.sysdeps->alloc_pages(
+      (size + NNLC_PAGE_SIZE - 1) / NNLC_PAGE_SIZE);
+}
+
+static void map_free(void *p, size_t size) {
+  if (__nnlc_internal_data.sysdeps->alloc_pages == NULL)
+    free(p);
+  else
+    __nnlc_internal_data.sysdeps->free_pages(
+        p, (size + NNLC_PAGE_SIZE - 1) / NNLC_PAGE_SIZE);
+}
+
+/* Read the file intptr_t handle of size bytes with as few file_read()
+ * as possible, straight into its final memory. Returns 0 or -errno */
+static int map_read(intptr_t handle, const void **data, size_t *size) {
+  const int64_t end =
+      __nnlc_internal_data.sysdeps->file_seek(handle, 0, SEEK_END);
+  size_t got = 0;
+  char *p;
 
+  if (end < 0) return end;
+  if (end == 0) {
+    *data = empty_file;
+    *size = 0;
+    return 0;
+  }
+  if ((uint64_t)end > SIZE_MAX) return -ENOMEM;
+  if (__nnlc_internal_data.sysdeps->file_seek(handle, 0, SEEK_SET) < 0)
+    return -EIO;
+
+  p = map_alloc(end);
+  if (p == NULL) return -ENOMEM;
+  while (got < (size_t)end) {
+    const ssize_t n =
+        __nnlc_internal_data.sysdeps->file_read(handle, p + got, end - got);
+    if (n < 0) {
+      map_free(p, end);
+      return n;
+    }
+    if (n == 0) break; /* the file shrank */
+    got += n;
+  }
+
+  if (got == 0) {
+    map_free(p, end);
+    p = (char *)empty_file;
+  } else if (__nnlc_internal_data.sysdeps->alloc_pages != NULL) {
+    /* free_pages() takes any sub-range: drop the pages not read */
+    const size_t used = (got + NNLC_PAGE_SIZE - 1) / NNLC_PAGE_SIZE;
+    const size_t npages = (end + NNLC_PAGE_SIZE - 1) / NNLC_PAGE_SIZE;
+    if (npages > used)
+      __nnlc_internal_data.sysdeps->free_pages(
+          p + used * NNLC_PAGE_SIZE, npages - used);
+  }
+  *data = p;
+  *size = got;
   return 0;
 }
 
+const void *nnlc_map_file(const char *path, size_t *size) {
+  const struct nnlc_sysdeps *sysdeps = __nnlc_internal_data.sysdeps;
+  const void *data = NULL;
+  intptr_t handle;
+  int rc;
+
+  if (path == NULL || size == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  if (sysdeps->map_file != NULL) {
+    rc = sysdeps->map_file(path, &data, size);
+  } else if (sysdeps->file_open == NULL) {
+    rc = -ENOENT;
+  } else {
+    handle = sysdeps->file_open(path, NNLC_FILE_READ);
+    if (handle < 0) {
+      rc = handle;
+    } else {
+      rc = map_read(handle, &data, size);
+      sysdeps->file_close(handle);
+    }
+  }
+
+  if (rc < 0) {
+    errno = -rc;
+    return NULL;
+  }
+  return data;
+}
+
+void nnlc_unmap_file(const void *data, size_t size) {
+  if (data == NULL || size == 0) return;
+  if (__nnlc_internal_data.sysdeps->map_file != NULL)
+    __nnlc_internal_data.sysdeps->unmap_file(data, size);
+  else
+    map_free((void *)data, size);
+}
+
+int fclose(FILE *stream) {
+  FILE **p;
+  int rc;
+
+  if (!_is_valid_FILE(stream)) {
+    errno = EBADF;
+    return EOF;
+  }
+
+  rc = fflush(stream);
+  for (p = &open_streams; *p != NULL && *p != stream; p = &(*p)->next_open) {
+  }
+  if (*p == NULL) return rc; /* stdin, stdout and stderr stay open */
+  *p = stream->next_open;
+
+  if (stream->handle >= 0 &&
+      __nnlc_internal_data.sysdeps->file_close(stream->handle) < 0)
+    rc = EOF;
+  if (stream->buf_owned) free(stream->buf);
+  stream->magic = 0;
+  if (stream->mem != NULL) {
+    if (stream->mem->owned) free(stream->mem->buf);
+    free(stream->mem);
+  } else {
+    free(stream);
+  }
+  return rc;
+}
+
+void __nnlc_stdio_finalize(void) {
+  fflush(NULL);
+
+  /* nanolibc remains usable after exit(): later output goes straight
+   * to the runtime */
+  setvbuf(&__nnlc_internal_data.libc_stdout, NULL, _IONBF, 0);
+  setvbuf(&__nnlc_internal_data.libc_stderr, NULL, _IONBF, 0);
+}
+
 int perror(const char *s) {
   fprintf(stderr, "Error: %s\n", s);
   return 0;
 }
 
 /*
- * vprintf family of functions. Rely on tfp_format, provide required
- * callbacks and data for it to call the underlying runtime 'write'
- * functions. We use a small buffer on the stack to avoid calling the
- * underlying 'write' too often.
+ * printf family of functions. __nnlc_format produces the output,
+ * struct _printf_out collects it into a buffer that is handed over to
+ * the stream (or left in the caller's string) in large chunks.
  */
-struct _vprintf_putcf_data {
-  FILE *stream;
+struct _printf_out {
+  char *buf;
+  size_t cap;   /* size of buf */
+  size_t used;
+  FILE *stream; /* where a full buf goes, NULL for the sprintf family */
+  int newline;  /* a '\n' was produced */
+  int error;
+};
 
-  char *buff; /* allocated on the stack by vprintf */
-  size_t buff_capacity;
-  size_t nbuffered; /* slightly redundant with buff_capacity, we don't care */
+/* Size of the buffer used by vfprintf for unbuffered streams: a
+ * typical printf is still a single runtime write */
+#define PRINTF_STACK_BUF 1024
 
-  size_t total_written;
-};
+/* Empty out->buf. Returns 0 if there is no room to make (strings) */
+static int out_drain(struct _printf_out *out) {
+  FILE *stream = out->stream;
+
+  if (stream == NULL) return 0;
+
+  if (out->buf == stream->buf) { /* formatting in place */
+    stream->buf_used = out->used;
+    if (flush_buf(stream)) out->error = 1;
+  } else if (stream_write(stream, out->buf, out->used) != out->used) {
+    out->error = 1;
+  }
+  out->used = 0;
+  return 1;
+}
 
-/* Callback function for tfp_format to add the given char c to the buffer */
-static void _vprintf_putcf(void *p, char c) {
-  struct _vprintf_putcf_data *data = (struct _vprintf_putcf_data *)p;
+/* Callback function for __nnlc_format: copy the span to the buffer,
+ * spans larger than the buffer of a stream bypass it */
+static void _printf_emit(void *p, const char *s, size_t n) {
+  struct _printf_out *out = (struct _printf_out *)p;
 
-  /* sanity check */
-  if (data->nbuffered >= data->buff_capacity)
-    abort(); /* no assert(), to prevent infinite recursion */
+  if (!out->newline && memchr(s, '\n', n) != NULL) out->newline = 1;
 
-  data->buff[data->nbuffered++] = c;
+  if (n > out->cap - out->used && out->stream != NULL && n >= out->cap) {
+    out_drain(out);
+    if (stream_write(out->stream, s, n) != n) out->error = 1;
+    return;
+  }
 
-  /* need to flush buffer? */
-  if (data->nbuffered >= data->buff_capacity) {
-    int n = data->stream->write(data->buff, data->nbuffered);
-    if (n > 0) data->total_written += n;
-    data->nbuffered = 0;
+  while (n > 0) {
+    size_t room = out->cap - out->used;
+    if (room == 0) {
+      if (!out_drain(out)) return;
+      room = out->cap;
+    }
+    if (room > n) room = n;
+    memcpy(out->buf + out->used, s, room);
+    out->used += room;
+    s += room;
+    n -= room;
   }
 }
 
+static void out_init(struct _printf_out *out, char *buf, size_t cap,
+                     size_t used, FILE *stream) {
+  out->buf = buf;
+  out->cap = cap;
+  out->used = used;
+  out->stream = stream;
+  out->newline = 0;
+  out->error = 0;
+}
+
 int vfprintf(FILE *stream, const char *format, va_list ap) {
-  char buff[64]; /* any size >= 1 is Ok */
-  struct _vprintf_putcf_data data;
+  char stack_buf[PRINTF_STACK_BUF];
+  struct _printf_out out;
+  int total;
 
-  if (!_is_valid_FILE(stream) || !stream->write) return -1;
+  if (!begin_write(stream)) return -1;
 
-  data.stream = stream;
-  data.buff_capacity = sizeof(buff);
-  data.buff = buff;
-  data.nbuffered = 0;
-  data.total_written = 0;
-  tfp_format(&data, _vprintf_putcf, format, ap);
+  /* buffered streams: format straight into their buffer */
+  if (stream->buf_size > 0)
+    out_init(&out, stream->buf, stream->buf_size, stream->buf_used, stream);
+  else
+    out_init(&out, stack_buf, sizeof(stack_buf), 0, stream);
+  total = __nnlc_format(&out, _printf_emit, format, ap);
 
-  /* chars remaining in buffer? */
-  if (data.nbuffered > 0) {
-    int n = stream->write(data.buff, data.nbuffered);
-    if (n > 0) data.total_written += n;
+  if (out.buf == stream->buf) {
+    stream->buf_used = out.used;
+    if (out.newline && stream->mode == _IOLBF && flush_buf(stream))
+      out.error = 1;
+  } else if (out.used > 0) {
+    out_drain(&out);
   }
 
-  return data.total_written;
+  return out.error ? -1 : total;
 }
 
 int fprintf(FILE *stream, const char *format, ...) {
@@ -167,77 +988,166 @@ int printf(const char *format, ...) {
 }
 
 /*
- * vsnprintf family of functions. Rely on tfp_format, provide required
- * callbacks and data for it to fill the buffer provided by caller.
+ * vsnprintf family of functions: the output stops at the end of the
+ * buffer provided by caller, the rest is only counted.
  */
-struct _vsnprintf_putcf_data {
-  size_t dest_capacity;
-  char *dest;
-  size_t dest_used;
-};
+int vsnprintf(char *str, size_t size, const char *format, va_list ap) {
+  struct _printf_out out;
+  int total;
 
-static void _vsnprintf_putcf(void *p, char c) {
-  struct _vsnprintf_putcf_data *data = (struct _vsnprintf_putcf_data *)p;
-  if (data->dest_used < data->dest_capacity) data->dest[data->dest_used] = c;
+  out_init(&out, str, (size > 0) ? size - 1 : 0, 0, NULL);
+  total = __nnlc_format(&out, _printf_emit, format, ap);
+  if (size > 0) str[out.used] = '\0';
 
-  data->dest_used++;
+  return total;
 }
 
-int vsnprintf(char *str, size_t size, const char *format, va_list ap) {
-  struct _vsnprintf_putcf_data data;
+int snprintf(char *str, size_t size, const char *format, ...) {
+  va_list ap;
+  int retval;
 
-  data.dest = str;
-  data.dest_capacity = size;
-  data.dest_used = 0;
-  tfp_format(&data, _vsnprintf_putcf, format, ap);
+  va_start(ap, format);
+  retval = vsnprintf(str, size, format, ap);
+  va_end(ap);
+  return retval;
+}
 
-  if (data.dest_used < size)
-    data.dest[data.dest_used] = '\0';
-  else if (size > 0)
-    data.dest[size - 1] = '\0';
+/*
+ * vsprintf family of functions: the buffer provided by caller is
+ * assumed to be large enough.
+ */
+int vsprintf(char *str, const char *format, va_list ap) {
+  struct _printf_out out;
+  int total;
 
-  return data.dest_used;
+  out_init(&out, str, (size_t)-1, 0, NULL);
+  total = __nnlc_format(&out, _printf_emit, format, ap);
+  str[out.used] = '\0';
+
+  return total;
 }
 
-int snprintf(char *str, size_t size, const char *format, ...) {
+int sprintf(char *str, const char *format, ...) {
   va_list ap;
   int retval;
 
   va_start(ap, format);
-  retval = vsnprintf(str, size, format, ap);
+  retval = vsprintf(str, format, ap);
   va_end(ap);
   return retval;
 }
 
 /*
- * vsprintf family of functions. Rely on tfp_format, provide required
- * callbacks and data for it to fill the buffer provided by caller.
+ * nnlc_strbuf and the asprintf family: the output is formatted in a
+ * single pass, into a heap buffer that doubles in size when full.
  */
-struct _vsprintf_putcf_data {
-  char *dest;
-  size_t dest_used;
-};
+#define STRBUF_MIN_CAP 64
 
-static void _vsprintf_putcf(void *p, char c) {
-  struct _vsprintf_putcf_data *data = (struct _vsprintf_putcf_data *)p;
-  data->dest[data->dest_used++] = c;
+void nnlc_strbuf_init(struct nnlc_strbuf *sb) {
+  sb->buf = NULL;
+  sb->len = 0;
+  sb->cap = 0;
+  sb->error = 0;
 }
 
-int vsprintf(char *str, const char *format, va_list ap) {
-  struct _vsprintf_putcf_data data;
-  data.dest = str;
-  data.dest_used = 0;
-  tfp_format(&data, _vsprintf_putcf, format, ap);
-  data.dest[data.dest_used] = '\0';
-  return data.dest_used;
+void nnlc_strbuf_reset(struct nnlc_strbuf *sb) {
+  sb->len = 0;
+  sb->error = 0;
+  if (sb->buf != NULL) sb->buf[0] = '\0';
 }
 
-int sprintf(char *str, const char *format, ...) {
+void nnlc_strbuf_free(struct nnlc_strbuf *sb) {
+  free(sb->buf);
+  nnlc_strbuf_init(sb);
+}
+
+const char *nnlc_strbuf_str(const struct nnlc_strbuf *sb) {
+  return (sb->buf != NULL) ? sb->buf : "";
+}
+
+/* Make room for n more bytes and the NUL. Returns 0 or -1 */
+static int strbuf_grow(struct nnlc_strbuf *sb, size_t n) {
+  size_t need, cap;
+  char *buf;
+
+  if (sb->error) return -1;
+  if (sb->cap > sb->len && n < sb->cap - sb->len) return 0;
+
+  if (__builtin_add_overflow(sb->len, n, &need) || need == (size_t)-1) {
+    sb->error = 1;
+    return -1;
+  }
+  ++need;
+  cap = (sb->cap > 0) ? sb->cap : STRBUF_MIN_CAP;
+  while (cap < need) cap = (cap > (size_t)-1 / 2) ? need : 2 * cap;
+
+  buf = realloc(sb->buf, cap);
+  if (buf == NULL) {
+    sb->error = 1;
+    return -1;
+  }
+  sb->buf = buf;
+  sb->cap = cap;
+  return 0;
+}
+
+char *nnlc_strbuf_release(struct nnlc_strbuf *sb) {
+  char *buf;
+
+  if (sb->buf == NULL && strbuf_grow(sb, 0)) return NULL;
+  buf = sb->buf;
+  buf[sb->len] = '\0';
+  nnlc_strbuf_init(sb);
+  return buf;
+}
+
+int nnlc_strbuf_append(struct nnlc_strbuf *sb, const char *s, size_t n) {
+  if (strbuf_grow(sb, n)) return -1;
+  memcpy(sb->buf + sb->len, s, n);
+  sb->len += n;
+  sb->buf[sb->len] = '\0';
+  return 0;
+}
+
+/* Callback function for __nnlc_format */
+static void _strbuf_emit(void *p, const char *s, size_t n) {
+  nnlc_strbuf_append((struct nnlc_strbuf *)p, s, n);
+}
+
+int nnlc_strbuf_vprintf(struct nnlc_strbuf *sb, const char *format,
+                        va_list ap) {
+  const int total = __nnlc_format(sb, _strbuf_emit, format, ap);
+  return sb->error ? -1 : total;
+}
+
+int nnlc_strbuf_printf(struct nnlc_strbuf *sb, const char *format, ...) {
   va_list ap;
   int retval;
 
   va_start(ap, format);
-  retval = vsprintf(str, format, ap);
+  retval = nnlc_strbuf_vprintf(sb, format, ap);
+  va_end(ap);
+  return retval;
+}
+
+int vasprintf(char **strp, const char *format, va_list ap) {
+  struct nnlc_strbuf sb = NNLC_STRBUF_INIT;
+  const int total = nnlc_strbuf_vprintf(&sb, format, ap);
+
+  *strp = (total >= 0) ? nnlc_strbuf_release(&sb) : NULL;
+  if (*strp == NULL) {
+    nnlc_strbuf_free(&sb);
+    return -1;
+  }
+  return total;
+}
+
+int asprintf(char **strp, const char *format, ...) {
+  va_list ap;
+  int retval;
+
+  va_start(ap, format);
+  retval = vasprintf(strp, format, ap);
   va_end(ap);
   return retval;
 }
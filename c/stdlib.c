@@ -28,6 +28,7 @@
 void abort() { exit(-1); }
 
 void exit(int status) {
+  _nnlc_finalize();
   __nnlc_internal_data.sysdeps->exit(status);
 
   /* runtime's exit() should not return */
@@ -17,10 +17,15 @@
  */
 
 #include <stddef.h>
+#include <stdint.h>
 #include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "third_party/nanolibc/c/libc_internals.h"
+
+#if !defined(__x86_64__) /* see string_x86_64.c */
+
 /* These are weak symbols, so that we continue using gnu-efi's version
  * when we link against it */
 int memcmp(const void *p1, const void *p2, size_t n)
@@ -32,84 +37,190 @@ void *memmove(void *dstpp, const void *srcpp, size_t n)
 void *memset(void *dstpp, int c, size_t n)
     __attribute__ ((weak));
 
-/* Highly NON optimized, but simple */
+/* Generic versions working a word at a time */
+typedef unsigned long word_t __attribute__((may_alias));
+typedef unsigned long unaligned_word_t __attribute__((aligned(1), may_alias));
+#define WORD_MASK (sizeof(word_t) - 1)
+
+/* Skip the equal words, then look for the first different byte */
 int memcmp(const void *p1, const void *p2, size_t n) {
-  const char *s1 = p1;
-  const char *s2 = p2;
+  const unsigned char *s1 = p1;
+  const unsigned char *s2 = p2;
+
+  for (; n >= sizeof(word_t); n -= sizeof(word_t)) {
+    if (*(const unaligned_word_t *)s1 != *(const unaligned_word_t *)s2)
+      break;
+    s1 += sizeof(word_t);
+    s2 += sizeof(word_t);
+  }
 
-  while (n > 0) {
+  for (; n > 0; --n, ++s1, ++s2)
     if (*s1 != *s2) return *s1 - *s2;
 
-    s1++;
-    s2++;
-    n--;
+  return 0;
+}
+
+int nnlc_memeq(const void *p1, const void *p2, size_t n) {
+  const unsigned char *s1 = p1;
+  const unsigned char *s2 = p2;
+
+  for (; n >= sizeof(word_t); n -= sizeof(word_t)) {
+    if (*(const unaligned_word_t *)s1 != *(const unaligned_word_t *)s2)
+      return 0;
+    s1 += sizeof(word_t);
+    s2 += sizeof(word_t);
   }
 
-  return 0;
+  for (; n > 0; --n)
+    if (*s1++ != *s2++) return 0;
+
+  return 1;
 }
 
-/* Highly NON optimized, but simple */
 void *memcpy(void *dstpp, const void *srcpp, size_t n) {
   char *d = dstpp;
   const char *s = srcpp;
 
-  while (n > 0) {
-    *d++ = *s++;
-    n--;
+  for (; n > 0 && ((uintptr_t)d & WORD_MASK); --n) *d++ = *s++;
+  for (; n >= sizeof(word_t); n -= sizeof(word_t)) {
+    *(word_t *)d = *(const unaligned_word_t *)s;
+    d += sizeof(word_t);
+    s += sizeof(word_t);
   }
+  for (; n > 0; --n) *d++ = *s++;
 
   return dstpp;
 }
 
-/* Highly NON optimized, but simple */
 void *memmove(void *dstpp, const void *srcpp, size_t n) {
-  if (dstpp <= srcpp) {
+  char *d = (char *)dstpp + n;
+  const char *s = (const char *)srcpp + n;
+
+  /* d < s, or no overlap: copying forward is fine */
+  if ((uintptr_t)dstpp - (uintptr_t)srcpp >= n)
     return memcpy(dstpp, srcpp, n);
-  }
-  char *d = dstpp + n;
-  const char *s = srcpp + n;
 
-  while (n > 0) {
-    *--d = *--s;
-    n--;
+  for (; n > 0 && ((uintptr_t)d & WORD_MASK); --n) *--d = *--s;
+  for (; n >= sizeof(word_t); n -= sizeof(word_t)) {
+    d -= sizeof(word_t);
+    s -= sizeof(word_t);
+    *(word_t *)d = *(const unaligned_word_t *)s;
   }
+  for (; n > 0; --n) *--d = *--s;
 
   return dstpp;
 }
 
-/* Highly NON optimized, but simple */
 void *memset(void *dstpp, int c, size_t n) {
+  const word_t w = (unsigned char)c * (~(word_t)0 / 0xff);
   char *d = dstpp;
 
-  while (n > 0) {
-    *d++ = c;
-    n--;
-  }
+  for (; n > 0 && ((uintptr_t)d & WORD_MASK); --n) *d++ = c;
+  for (; n >= sizeof(word_t); n -= sizeof(word_t), d += sizeof(word_t))
+    *(word_t *)d = w;
+  for (; n > 0; --n) *d++ = c;
 
   return dstpp;
 }
 
+/*
+ * Word at a time searches ("SWAR"): HAS_ZERO() is non-zero iff one of
+ * the bytes of w is 0. Only whole aligned words are read, so they
+ * never cross into the next page.
+ */
+#define ONES (~(word_t)0 / 0xff)
+#define HIGHS (ONES << 7)
+#define HAS_ZERO(w) (((w) - ONES) & ~(w) & HIGHS)
+
+void *memchr(const void *spp, int c, size_t n) {
+  const unsigned char *s = spp;
+  const word_t cmask = (unsigned char)c * ONES;
+
+  for (; n > 0 && ((uintptr_t)s & WORD_MASK); --n, ++s)
+    if (*s == (unsigned char)c) return (void *)s;
+
+  for (; n >= sizeof(word_t); n -= sizeof(word_t), s += sizeof(word_t))
+    if (HAS_ZERO(*(const word_t *)s ^ cmask)) break;
+
+  for (; n > 0; --n, ++s)
+    if (*s == (unsigned char)c) return (void *)s;
+
+  return NULL;
+}
+
 const void *rawmemchr(const void *spp, int c) {
   const unsigned char *s = spp;
+  const word_t cmask = (unsigned char)c * ONES;
+
+  for (; (uintptr_t)s & WORD_MASK; ++s)
+    if (*s == (unsigned char)c) return s;
+
+  while (!HAS_ZERO(*(const word_t *)s ^ cmask)) s += sizeof(word_t);
 
   while (*s != (unsigned char)c) s++;
 
   return s;
 }
 
-void *memchr(const void *spp, int c, size_t n) {
-  const unsigned char *s = spp;
+size_t strlen(const char *s) {
+  const char *p = s;
 
-  while (n-- != 0) {
-    if (*s == (unsigned char)c) {
-      return (void*)s;
-    }
-    s++;
+  for (; (uintptr_t)p & WORD_MASK; ++p)
+    if (*p == '\0') return p - s;
+
+  while (!HAS_ZERO(*(const word_t *)p)) p += sizeof(word_t);
+
+  while (*p) ++p;
+
+  return p - s;
+}
+
+char *strchr(const char *s, int i) {
+  const word_t cmask = (unsigned char)i * ONES;
+  word_t w;
+
+  for (; (uintptr_t)s & WORD_MASK; ++s) {
+    if (*s == (char)i) return (char *)s;
+    if (*s == '\0') return NULL;
   }
 
+  for (;; s += sizeof(word_t)) {
+    w = *(const word_t *)s;
+    if (HAS_ZERO(w) || HAS_ZERO(w ^ cmask)) break;
+  }
+
+  for (; *s != (char)i; ++s)
+    if (*s == '\0') return NULL;
+
+  return (char *)s;
+}
+
+/* Scanning backwards */
+void *memrchr(const void *spp, int c, size_t n) {
+  const char *s = spp;
+  const char *p = s + n;
+  const word_t cmask = (unsigned char)c * ONES;
+
+  for (; p > s && ((uintptr_t)p & WORD_MASK); --p)
+    if (p[-1] == (char)c) return (void *)(p - 1);
+
+  for (; p - s >= (ptrdiff_t)sizeof(word_t); p -= sizeof(word_t))
+    if (HAS_ZERO(*(const word_t *)(p - sizeof(word_t)) ^ cmask)) break;
+
+  for (; p > s; --p)
+    if (p[-1] == (char)c) return (void *)(p - 1);
+
   return NULL;
 }
 
+char *strrchr(const char *s, int i) {
+  const size_t len = strlen(s);
+
+  if ((char)i == '\0') return (char *)s + len;
+
+  return memrchr(s, i, len);
+}
+
 int strcmp(const char *p1, const char *p2) {
   const unsigned char *s1 = (const unsigned char *)p1;
   const unsigned char *s2 = (const unsigned char *)p2;
@@ -124,7 +235,6 @@ int strcmp(const char *p1, const char *p2) {
   return 0;
 }
 
-/* Highly NON optimized, but simple */
 int strncmp(const char *p1, const char *p2, size_t n) {
   const unsigned char *s1 = (const unsigned char *)p1;
   const unsigned char *s2 = (const unsigned char *)p2;
@@ -139,102 +249,304 @@ int strncmp(const char *p1, const char *p2, size_t n) {
   return 0;
 }
 
-char *strcpy(char *dest, const char *src) {
-  char *d = dest;
-  const char *s = src;
+#endif /* __x86_64__ */
 
-  while (*s) *d++ = *s++;
+/*
+ * Copies and concatenations: one scan of the source with the fast
+ * strlen/strnlen/memchr, then one memcpy.
+ */
+
+size_t strnlen(const char *s, size_t maxlen) {
+  const char *end = memchr(s, '\0', maxlen);
+  return (end != NULL) ? (size_t)(end - s) : maxlen;
+}
 
-  *d = '\0';
+char *stpcpy(char *dest, const char *src) {
+  const size_t len = strlen(src);
+  memcpy(dest, src, len + 1);
+  return dest + len;
+}
+
+char *strcpy(char *dest, const char *src) {
+  stpcpy(dest, src);
   return dest;
 }
 
-/* strncpy borrowed from Linux man pages 3.35 */
+char *stpncpy(char *dest, const char *src, size_t n) {
+  const size_t len = strnlen(src, n);
+  memcpy(dest, src, len);
+  memset(dest + len, '\0', n - len);
+  return dest + len;
+}
+
 char *strncpy(char *dest, const char *src, size_t n) {
-  size_t i;
+  stpncpy(dest, src, n);
+  return dest;
+}
 
-  for (i = 0; i < n && src[i] != '\0'; i++) dest[i] = src[i];
-  for (; i < n; i++) dest[i] = '\0';
+char *strcat(char *dest, const char *src) {
+  stpcpy(dest + strlen(dest), src);
+  return dest;
+}
 
+char *strncat(char *dest, const char *src, size_t n) {
+  const size_t len = strnlen(src, n);
+  char *d = dest + strlen(dest);
+  memcpy(d, src, len);
+  d[len] = '\0';
   return dest;
 }
 
-/* Highly NON optimized, but simple */
-size_t strlen(const char *s) {
-  size_t i;
-  for (i = 0; *s; ++s, ++i) continue;
-  return i;
+size_t strlcpy(char *dest, const char *src, size_t size) {
+  const size_t len = strlen(src);
+
+  if (size > 0) {
+    const size_t n = (len < size) ? len : size - 1;
+    memcpy(dest, src, n);
+    dest[n] = '\0';
+  }
+
+  return len;
 }
 
-char *strchr(const char *s, int i) {
-  for (; *s; ++s)
-    if (*s == i) return (char *)s;
+size_t strlcat(char *dest, const char *src, size_t size) {
+  const size_t len = strnlen(dest, size);
+
+  /* no '\0' in dest: nothing appended */
+  if (len == size) return size + strlen(src);
+
+  return len + strlcpy(dest + len, src, size - len);
+}
+
+void *memccpy(void *dstpp, const void *srcpp, int c, size_t n) {
+  const char *end = memchr(srcpp, c, n);
 
+  if (end != NULL) {
+    n = end - (const char *)srcpp + 1;
+    memcpy(dstpp, srcpp, n);
+    return (char *)dstpp + n;
+  }
+
+  memcpy(dstpp, srcpp, n);
   return NULL;
 }
 
-char *strrchr(const char *s, int i) {
-  const char *last = NULL;
+/*
+ * Two-Way string matching (Crochemore & Perrin, 1991): linear time,
+ * constant space. The needle is split at its critical factorization
+ * n = u.v; v is matched left to right, then u right to left. On a
+ * mismatch in v the needle moves past it, on a mismatch in u it moves
+ * by the period of the needle. For periodic needles, the prefix
+ * already known to match ('mem') is not compared again.
+ *
+ * On top of that, the last byte of each window is looked up first in
+ * a table of the bytes of the needle, skipping up to a whole needle
+ * length at once (Horspool).
+ */
 
-  for (; *s; ++s)
-    if (*s == i) last = s;
+/* Start of the maximal suffix of n for the given byte ordering, and
+ * its period in *period */
+static size_t maximal_suffix(const unsigned char *n, size_t nlen,
+                             int reverse, size_t *period) {
+  size_t start = (size_t)-1; /* start of the suffix, minus one */
+  size_t j = 0, k = 1, p = 1;
+
+  while (j + k < nlen) {
+    const unsigned char a = n[start + k], b = n[j + k];
+    if (a == b) {
+      if (k == p) {
+        j += p;
+        k = 1;
+      } else {
+        ++k;
+      }
+    } else if (reverse ? a < b : a > b) {
+      j += k;
+      k = 1;
+      p = j - start;
+    } else {
+      start = j++;
+      k = p = 1;
+    }
+  }
 
-  return (char *)last;
+  *period = p;
+  return start;
 }
 
-const char *strstr(const char *haystack, const char *needle) {
-  const char *h = haystack;
-  const char *n = needle;
-  const char *found = NULL;
+static const char *two_way(const unsigned char *h, size_t hlen,
+                           const unsigned char *n, size_t nlen) {
+  const unsigned char *const end = h + hlen;
+  size_t shift[256]; /* position after the last occurrence of a byte */
+  size_t split, period, period2, split2, mem = 0, mem0, i, k;
+
+  memset(shift, 0, sizeof(shift));
+  for (i = 0; i < nlen; i++) shift[n[i]] = i + 1;
+
+  /* critical factorization: the later of both maximal suffixes */
+  split = maximal_suffix(n, nlen, 0, &period);
+  split2 = maximal_suffix(n, nlen, 1, &period2);
+  if (split2 + 1 > split + 1) {
+    split = split2;
+    period = period2;
+  }
 
-  if (*needle == '\0') return haystack;
+  if (memcmp(n, n + period, split + 1)) {
+    /* not periodic: any shift up to this one is safe */
+    mem0 = 0;
+    period = (split > nlen - split - 1 ? split : nlen - split - 1) + 1;
+  } else {
+    mem0 = nlen - period;
+  }
 
-  while (*h) {
-    if ((found != NULL) && (*h != *n)) {
-      found = NULL;
-      n = needle;
+  while ((size_t)(end - h) >= nlen) {
+    /* last byte of the window first */
+    k = nlen - shift[h[nlen - 1]];
+    if (k) {
+      if (k < mem) k = mem;
+      h += k;
+      mem = 0;
+      continue;
     }
 
-    if (*h == *n) {
-      if (found == NULL) found = h;
-      n++;
-      if (*n == '\0') return found;
+    /* right part */
+    for (k = (split + 1 > mem) ? split + 1 : mem; k < nlen && n[k] == h[k];
+         ++k)
+      continue;
+    if (k < nlen) {
+      h += k - split;
+      mem = 0;
+      continue;
     }
 
-    h++;
+    /* left part */
+    for (k = split + 1; k > mem && n[k - 1] == h[k - 1]; --k) continue;
+    if (k <= mem) return (const char *)h;
+
+    h += period;
+    mem = mem0;
   }
 
   return NULL;
 }
 
-/* strspn borrowed from eglibc 2.17 */
+#if !defined(__x86_64__) /* see string_x86_64.c */
+/* Check the candidates having the first and last bytes of the needle */
+const char *__nnlc_memmem_short(const char *h, size_t hlen, const char *n,
+                                size_t nlen) {
+  const char *const last = h + hlen - nlen; /* last possible match */
+
+  while (h <= last) {
+    h = memchr(h, n[0], last - h + 1);
+    if (h == NULL) return NULL;
+    if (h[nlen - 1] == n[nlen - 1] && !memcmp(h + 1, n + 1, nlen - 2))
+      return h;
+    ++h;
+  }
+
+  return NULL;
+}
+#endif
+
+void *memmem(const void *haystack, size_t hlen, const void *needle,
+             size_t nlen) {
+  const char *h = haystack;
+
+  if (nlen == 0) return (void *)haystack;
+  if (nlen > hlen) return NULL;
+  if (nlen == 1) return memchr(haystack, *(const char *)needle, hlen);
+
+  /* Two-Way has a startup cost, not worth it for short needles */
+  if (nlen <= NNLC_MEMMEM_SHORT)
+    return (void *)__nnlc_memmem_short(h, hlen, needle, nlen);
+
+  return (void *)two_way(haystack, hlen, needle, nlen);
+}
+
+const char *strstr(const char *haystack, const char *needle) {
+  const size_t nlen = strlen(needle);
+
+  if (nlen == 0) return haystack;
+
+  haystack = strchr(haystack, needle[0]);
+  if (haystack == NULL || nlen == 1) return haystack;
+
+  return memmem(haystack, strlen(haystack), needle, nlen);
+}
+
+/*
+ * strspn() and friends look up each byte of the string in a 256-bit
+ * set built once per call from the accept/reject bytes, or use
+ * SSE4.2 pcmpistri for small sets when the CPU has it.
+ */
+#define BYTESET_WORD_BITS (8 * sizeof(unsigned long))
+
+struct byteset {
+  unsigned long bits[256 / BYTESET_WORD_BITS];
+};
+
+static inline void byteset_add(struct byteset *set, unsigned char c) {
+  set->bits[c / BYTESET_WORD_BITS] |= 1UL << (c % BYTESET_WORD_BITS);
+}
+
+static inline int byteset_has(const struct byteset *set, unsigned char c) {
+  return (set->bits[c / BYTESET_WORD_BITS] >> (c % BYTESET_WORD_BITS)) & 1;
+}
+
+static void byteset_init(struct byteset *set, const char *bytes) {
+  memset(set, 0, sizeof(*set));
+  for (; *bytes != '\0'; ++bytes) byteset_add(set, *bytes);
+}
+
 size_t strspn(const char *s, const char *accept) {
-  const char *p;
-  const char *a;
-  size_t count = 0;
-
-  for (p = s; *p != '\0'; ++p) {
-    for (a = accept; *a != '\0'; ++a)
-      if (*p == *a) break;
-    if (*a == '\0')
-      return count;
-    else
-      ++count;
+  const unsigned char *p = (const unsigned char *)s;
+  struct byteset set;
+
+  if (accept[0] == '\0') return 0;
+  if (accept[1] == '\0') {
+    while (*p == (unsigned char)accept[0]) ++p;
+    return p - (const unsigned char *)s;
   }
 
-  return count;
+#if defined(__x86_64__)
+  if (__nnlc_internal_data.cpu_features & NNLC_CPU_SSE42) {
+    const size_t n = __nnlc_span_sse42(s, accept, 0);
+    if (n != (size_t)-1) return n;
+  }
+#endif
+
+  byteset_init(&set, accept); /* '\0' is not in the set */
+  while (byteset_has(&set, *p)) ++p;
+
+  return p - (const unsigned char *)s;
 }
 
-/* Naive O(M*N) implementation, good enough if "accept" is small */
-const char *strpbrk(const char *s, const char *accept) {
-  while (*s != '\0') {
-    const char *a = accept;
-    while (*a != '\0')
-      if (*a++ == *s) return s;
-    ++s;
+size_t strcspn(const char *s, const char *reject) {
+  const unsigned char *p = (const unsigned char *)s;
+  struct byteset set;
+
+  if (reject[0] == '\0' || reject[1] == '\0') {
+    const char *found = strchr(s, reject[0]);
+    return (found != NULL) ? (size_t)(found - s) : strlen(s);
   }
 
-  return NULL;
+#if defined(__x86_64__)
+  if (__nnlc_internal_data.cpu_features & NNLC_CPU_SSE42) {
+    const size_t n = __nnlc_span_sse42(s, reject, 1);
+    if (n != (size_t)-1) return n;
+  }
+#endif
+
+  byteset_init(&set, reject);
+  byteset_add(&set, '\0');
+  while (!byteset_has(&set, *p)) ++p;
+
+  return p - (const unsigned char *)s;
+}
+
+const char *strpbrk(const char *s, const char *accept) {
+  s += strcspn(s, accept);
+  return (*s != '\0') ? s : NULL;
 }
 
 /* strtok_r borrowed from eglibc 2.17's strtok */
@@ -252,10 +564,10 @@ char *strtok_r(char *s, const char *delim, char **saveptr) {
 
   /* Find the end of the token.  */
   token = s;
-  s = (char *)strpbrk(token, delim);
-  if (s == NULL) {
+  s += strcspn(s, delim);
+  if (*s == '\0') {
     /* This token finishes the string.  */
-    *saveptr = (char *)rawmemchr(token, '\0');
+    *saveptr = s;
   } else {
     /* Terminate the token and make *saveptr point past it.  */
     *s = '\0';
@@ -273,16 +585,13 @@ char *strdup(const char *s) {
   const size_t len = strlen(s);
   char *result = malloc(len+1);
   if (NULL != result) {
-    strcpy(result, s);
+    memcpy(result, s, len + 1);
   }
   return result;
 }
 
 char *strndup(const char *s, size_t n) {
-  size_t len = strlen(s);
-  if (n < len) {
-    len = n;
-  }
+  const size_t len = strnlen(s, n);
   char *result = malloc(len+1);
   if (NULL != result) {
     memcpy(result, s, len);
@@ -0,0 +1,1220 @@
+//  Copyright 2022 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/*
+ * x86-64 implementation of the hottest string.h functions.
+ *
+ * The most used ones come in SSE2 (always available on x86-64), AVX2
+ * and AVX-512 flavours. __nnlc_select_string_ops(), called once by
+ * _nnlc_initialize(), picks the best flavours for the CPU we run on;
+ * until then the SSE2 ones are used. ERMS (fast rep movsb/stosb) is
+ * used for large copies and fills when the CPU has it.
+ *
+ * Small copies/fills are handled without loops by overlapping
+ * loads/stores from both ends of the buffers. Larger sizes load the
+ * first and last vectors ahead, then loop over aligned destination
+ * vectors. Searches only use aligned loads: they may read past the
+ * end of the string/buffer, but never into another page.
+ */
+
+#if defined(__x86_64__)
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "third_party/nanolibc/c/libc_internals.h"
+
+/* These are weak symbols, so that we continue using gnu-efi's version
+ * when we link against it */
+int memcmp(const void *p1, const void *p2, size_t n)
+    __attribute__ ((weak));
+void *memcpy(void *dstpp, const void *srcpp, size_t n)
+    __attribute__ ((weak));
+void *memmove(void *dstpp, const void *srcpp, size_t n)
+    __attribute__ ((weak));
+void *memset(void *dstpp, int c, size_t n)
+    __attribute__ ((weak));
+
+/* Not everybody compiles with SSE enabled (eg. firmware code) */
+#define NNLC_SSE2 __attribute__((target("sse2")))
+#define NNLC_SSE42 __attribute__((target("sse4.2")))
+#define NNLC_AVX2 __attribute__((target("avx2")))
+#define NNLC_AVX512 __attribute__((target("avx512f,avx512bw")))
+
+/* Below these sizes, wider loops and rep movsb/stosb don't pay off */
+#define NNLC_AVX2_MIN_SIZE 256
+#define NNLC_AVX512_MIN_SIZE 512
+#define NNLC_REP_MIN_SIZE 2048
+
+typedef uint32_t unaligned_u32 __attribute__((aligned(1), may_alias));
+typedef uint64_t unaligned_u64 __attribute__((aligned(1), may_alias));
+typedef char v16 __attribute__((vector_size(16), may_alias));
+typedef char unaligned_v16 __attribute__((vector_size(16), aligned(1),
+                                          may_alias));
+typedef char v32 __attribute__((vector_size(32), may_alias));
+typedef char unaligned_v32 __attribute__((vector_size(32), aligned(1),
+                                          may_alias));
+typedef char v64 __attribute__((vector_size(64), may_alias));
+typedef char unaligned_v64 __attribute__((vector_size(64), aligned(1),
+                                          may_alias));
+
+/* Bit i set when byte i of a and b are equal */
+static inline NNLC_SSE2 unsigned eq_mask16(v16 a, v16 b) {
+  return __builtin_ia32_pmovmskb128((v16)(a == b));
+}
+
+static inline NNLC_AVX2 uint32_t eq_mask32(v32 a, v32 b) {
+  return __builtin_ia32_pmovmskb256((v32)(a == b));
+}
+
+static inline NNLC_AVX512 uint64_t eq_mask64(v64 a, v64 b) {
+  return __builtin_ia32_cmpb512_mask(a, b, 0 /* EQ */, (uint64_t)-1);
+}
+
+/* The n lowest bits set, n <= 64 */
+static inline uint64_t low_bits(size_t n) {
+  return n >= 64 ? (uint64_t)-1 : ((uint64_t)1 << n) - 1;
+}
+
+/* Size from which rep movsb/stosb is used, never without ERMS */
+static size_t rep_min_size = (size_t)-1;
+
+/*
+ * Copy
+ */
+
+/* Copy n <= 64 bytes. Everything is loaded before anything is stored,
+ * so the buffers may overlap. */
+static inline NNLC_SSE2 void copy_small(char *d, const char *s, size_t n) {
+  if (n <= 16) {
+    if (n >= 8) {
+      const uint64_t a = *(const unaligned_u64 *)s;
+      const uint64_t b = *(const unaligned_u64 *)(s + n - 8);
+      *(unaligned_u64 *)d = a;
+      *(unaligned_u64 *)(d + n - 8) = b;
+    } else if (n >= 4) {
+      const uint32_t a = *(const unaligned_u32 *)s;
+      const uint32_t b = *(const unaligned_u32 *)(s + n - 4);
+      *(unaligned_u32 *)d = a;
+      *(unaligned_u32 *)(d + n - 4) = b;
+    } else if (n > 0) {
+      const char a = s[0], b = s[n / 2], c = s[n - 1];
+      d[0] = a;
+      d[n / 2] = b;
+      d[n - 1] = c;
+    }
+  } else if (n <= 32) {
+    const v16 a = *(const unaligned_v16 *)s;
+    const v16 b = *(const unaligned_v16 *)(s + n - 16);
+    *(unaligned_v16 *)d = a;
+    *(unaligned_v16 *)(d + n - 16) = b;
+  } else {
+    const v16 a = *(const unaligned_v16 *)s;
+    const v16 b = *(const unaligned_v16 *)(s + 16);
+    const v16 c = *(const unaligned_v16 *)(s + n - 32);
+    const v16 e = *(const unaligned_v16 *)(s + n - 16);
+    *(unaligned_v16 *)d = a;
+    *(unaligned_v16 *)(d + 16) = b;
+    *(unaligned_v16 *)(d + n - 32) = c;
+    *(unaligned_v16 *)(d + n - 16) = e;
+  }
+}
+
+/* Copy n > 64 bytes to lower addresses or to a non-overlapping
+ * buffer: any source vector is loaded before the store that may
+ * overwrite it. First and last vectors are stored last. */
+static NNLC_SSE2 void copy_forward_sse2(char *d, const char *s, size_t n) {
+  const v16 head = *(const unaligned_v16 *)s;
+  const v16 tail = *(const unaligned_v16 *)(s + n - 16);
+  char *const dst = d;
+  char *const dst_tail = d + n - 16;
+  const size_t skew = 16 - ((uintptr_t)d & 15);
+
+  d += skew;
+  s += skew;
+  n -= skew;
+  for (; n > 64; n -= 64, d += 64, s += 64) {
+    const v16 a = *(const unaligned_v16 *)s;
+    const v16 b = *(const unaligned_v16 *)(s + 16);
+    const v16 c = *(const unaligned_v16 *)(s + 32);
+    const v16 e = *(const unaligned_v16 *)(s + 48);
+    *(v16 *)d = a;
+    *(v16 *)(d + 16) = b;
+    *(v16 *)(d + 32) = c;
+    *(v16 *)(d + 48) = e;
+  }
+  for (; n > 16; n -= 16, d += 16, s += 16)
+    *(v16 *)d = *(const unaligned_v16 *)s;
+
+  *(unaligned_v16 *)dst = head;
+  *(unaligned_v16 *)dst_tail = tail;
+}
+
+/* Same as above, to higher overlapping addresses */
+static NNLC_SSE2 void copy_backward_sse2(char *d, const char *s, size_t n) {
+  const v16 head = *(const unaligned_v16 *)s;
+  const v16 tail = *(const unaligned_v16 *)(s + n - 16);
+  char *const dst = d;
+  char *const dst_tail = d + n - 16;
+  const size_t skew = (uintptr_t)(d + n) & 15;
+
+  d += n - skew;
+  s += n - skew;
+  n -= skew;
+  for (; n > 64; n -= 64) {
+    v16 a, b, c, e;
+    d -= 64;
+    s -= 64;
+    a = *(const unaligned_v16 *)(s + 48);
+    b = *(const unaligned_v16 *)(s + 32);
+    c = *(const unaligned_v16 *)(s + 16);
+    e = *(const unaligned_v16 *)s;
+    *(v16 *)(d + 48) = a;
+    *(v16 *)(d + 32) = b;
+    *(v16 *)(d + 16) = c;
+    *(v16 *)d = e;
+  }
+  for (; n > 16; n -= 16) {
+    d -= 16;
+    s -= 16;
+    *(v16 *)d = *(const unaligned_v16 *)s;
+  }
+
+  *(unaligned_v16 *)dst = head;
+  *(unaligned_v16 *)dst_tail = tail;
+}
+
+/* copy_forward_sse2() with 32-byte vectors, n > 128 */
+static NNLC_AVX2 void copy_forward_avx2(char *d, const char *s, size_t n) {
+  const v32 head = *(const unaligned_v32 *)s;
+  const v32 tail = *(const unaligned_v32 *)(s + n - 32);
+  char *const dst = d;
+  char *const dst_tail = d + n - 32;
+  const size_t skew = 32 - ((uintptr_t)d & 31);
+
+  d += skew;
+  s += skew;
+  n -= skew;
+  for (; n > 128; n -= 128, d += 128, s += 128) {
+    const v32 a = *(const unaligned_v32 *)s;
+    const v32 b = *(const unaligned_v32 *)(s + 32);
+    const v32 c = *(const unaligned_v32 *)(s + 64);
+    const v32 e = *(const unaligned_v32 *)(s + 96);
+    *(v32 *)d = a;
+    *(v32 *)(d + 32) = b;
+    *(v32 *)(d + 64) = c;
+    *(v32 *)(d + 96) = e;
+  }
+  for (; n > 32; n -= 32, d += 32, s += 32)
+    *(v32 *)d = *(const unaligned_v32 *)s;
+
+  *(unaligned_v32 *)dst = head;
+  *(unaligned_v32 *)dst_tail = tail;
+}
+
+/* copy_backward_sse2() with 32-byte vectors, n > 128 */
+static NNLC_AVX2 void copy_backward_avx2(char *d, const char *s, size_t n) {
+  const v32 head = *(const unaligned_v32 *)s;
+  const v32 tail = *(const unaligned_v32 *)(s + n - 32);
+  char *const dst = d;
+  char *const dst_tail = d + n - 32;
+  const size_t skew = (uintptr_t)(d + n) & 31;
+
+  d += n - skew;
+  s += n - skew;
+  n -= skew;
+  for (; n > 128; n -= 128) {
+    v32 a, b, c, e;
+    d -= 128;
+    s -= 128;
+    a = *(const unaligned_v32 *)(s + 96);
+    b = *(const unaligned_v32 *)(s + 64);
+    c = *(const unaligned_v32 *)(s + 32);
+    e = *(const unaligned_v32 *)s;
+    *(v32 *)(d + 96) = a;
+    *(v32 *)(d + 64) = b;
+    *(v32 *)(d + 32) = c;
+    *(v32 *)d = e;
+  }
+  for (; n > 32; n -= 32) {
+    d -= 32;
+    s -= 32;
+    *(v32 *)d = *(const unaligned_v32 *)s;
+  }
+
+  *(unaligned_v32 *)dst = head;
+  *(unaligned_v32 *)dst_tail = tail;
+}
+
+/* copy_forward_sse2() with 64-byte vectors, n > 256 */
+static NNLC_AVX512 void copy_forward_avx512(char *d, const char *s,
+                                            size_t n) {
+  const v64 head = *(const unaligned_v64 *)s;
+  const v64 tail = *(const unaligned_v64 *)(s + n - 64);
+  char *const dst = d;
+  char *const dst_tail = d + n - 64;
+  const size_t skew = 64 - ((uintptr_t)d & 63);
+
+  d += skew;
+  s += skew;
+  n -= skew;
+  for (; n > 256; n -= 256, d += 256, s += 256) {
+    const v64 a = *(const unaligned_v64 *)s;
+    const v64 b = *(const unaligned_v64 *)(s + 64);
+    const v64 c = *(const unaligned_v64 *)(s + 128);
+    const v64 e = *(const unaligned_v64 *)(s + 192);
+    *(v64 *)d = a;
+    *(v64 *)(d + 64) = b;
+    *(v64 *)(d + 128) = c;
+    *(v64 *)(d + 192) = e;
+  }
+  for (; n > 64; n -= 64, d += 64, s += 64)
+    *(v64 *)d = *(const unaligned_v64 *)s;
+
+  *(unaligned_v64 *)dst = head;
+  *(unaligned_v64 *)dst_tail = tail;
+}
+
+/* copy_backward_sse2() with 64-byte vectors, n > 256 */
+static NNLC_AVX512 void copy_backward_avx512(char *d, const char *s,
+                                             size_t n) {
+  const v64 head = *(const unaligned_v64 *)s;
+  const v64 tail = *(const unaligned_v64 *)(s + n - 64);
+  char *const dst = d;
+  char *const dst_tail = d + n - 64;
+  const size_t skew = (uintptr_t)(d + n) & 63;
+
+  d += n - skew;
+  s += n - skew;
+  n -= skew;
+  for (; n > 256; n -= 256) {
+    v64 a, b, c, e;
+    d -= 256;
+    s -= 256;
+    a = *(const unaligned_v64 *)(s + 192);
+    b = *(const unaligned_v64 *)(s + 128);
+    c = *(const unaligned_v64 *)(s + 64);
+    e = *(const unaligned_v64 *)s;
+    *(v64 *)(d + 192) = a;
+    *(v64 *)(d + 128) = b;
+    *(v64 *)(d + 64) = c;
+    *(v64 *)d = e;
+  }
+  for (; n > 64; n -= 64) {
+    d -= 64;
+    s -= 64;
+    *(v64 *)d = *(const unaligned_v64 *)s;
+  }
+
+  *(unaligned_v64 *)dst = head;
+  *(unaligned_v64 *)dst_tail = tail;
+}
+
+static inline void copy_rep_movsb(char *d, const char *s, size_t n) {
+  __asm__ volatile("rep movsb" : "+D"(d), "+S"(s), "+c"(n) : : "memory");
+}
+
+static NNLC_SSE2 void *memcpy_sse2(void *dstpp, const void *srcpp,
+                                   size_t n) {
+  if (n <= 64)
+    copy_small(dstpp, srcpp, n);
+  else if (n >= rep_min_size)
+    copy_rep_movsb(dstpp, srcpp, n);
+  else
+    copy_forward_sse2(dstpp, srcpp, n);
+
+  return dstpp;
+}
+
+static NNLC_AVX2 void *memcpy_avx2(void *dstpp, const void *srcpp,
+                                   size_t n) {
+  if (n <= 64)
+    copy_small(dstpp, srcpp, n);
+  else if (n >= rep_min_size)
+    copy_rep_movsb(dstpp, srcpp, n);
+  else if (n >= NNLC_AVX2_MIN_SIZE)
+    copy_forward_avx2(dstpp, srcpp, n);
+  else
+    copy_forward_sse2(dstpp, srcpp, n);
+
+  return dstpp;
+}
+
+static NNLC_AVX512 void *memcpy_avx512(void *dstpp, const void *srcpp,
+                                       size_t n) {
+  if (n <= 64)
+    copy_small(dstpp, srcpp, n);
+  else if (n >= rep_min_size)
+    copy_rep_movsb(dstpp, srcpp, n);
+  else if (n >= NNLC_AVX512_MIN_SIZE)
+    copy_forward_avx512(dstpp, srcpp, n);
+  else if (n >= NNLC_AVX2_MIN_SIZE)
+    copy_forward_avx2(dstpp, srcpp, n);
+  else
+    copy_forward_sse2(dstpp, srcpp, n);
+
+  return dstpp;
+}
+
+/* TRUE when memmove() may copy forward, ie. d < s or no overlap */
+static inline int may_copy_forward(const void *d, const void *s, size_t n) {
+  return (uintptr_t)d - (uintptr_t)s >= n;
+}
+
+/* TRUE when memmove() may use rep movsb, slow with overlapping
+ * buffers */
+static inline int may_copy_rep_movsb(const void *d, const void *s,
+                                     size_t n) {
+  return n >= rep_min_size && may_copy_forward(d, s, n) &&
+         may_copy_forward(s, d, n);
+}
+
+static NNLC_SSE2 void *memmove_sse2(void *dstpp, const void *srcpp,
+                                    size_t n) {
+  if (n <= 64)
+    copy_small(dstpp, srcpp, n);
+  else if (may_copy_rep_movsb(dstpp, srcpp, n))
+    copy_rep_movsb(dstpp, srcpp, n);
+  else if (may_copy_forward(dstpp, srcpp, n))
+    copy_forward_sse2(dstpp, srcpp, n);
+  else
+    copy_backward_sse2(dstpp, srcpp, n);
+
+  return dstpp;
+}
+
+static NNLC_AVX2 void *memmove_avx2(void *dstpp, const void *srcpp,
+                                    size_t n) {
+  if (n < NNLC_AVX2_MIN_SIZE)
+    return memmove_sse2(dstpp, srcpp, n);
+
+  if (may_copy_rep_movsb(dstpp, srcpp, n))
+    copy_rep_movsb(dstpp, srcpp, n);
+  else if (may_copy_forward(dstpp, srcpp, n))
+    copy_forward_avx2(dstpp, srcpp, n);
+  else
+    copy_backward_avx2(dstpp, srcpp, n);
+
+  return dstpp;
+}
+
+static NNLC_AVX512 void *memmove_avx512(void *dstpp, const void *srcpp,
+                                        size_t n) {
+  if (n < NNLC_AVX512_MIN_SIZE)
+    return memmove_avx2(dstpp, srcpp, n);
+
+  if (may_copy_rep_movsb(dstpp, srcpp, n))
+    copy_rep_movsb(dstpp, srcpp, n);
+  else if (may_copy_forward(dstpp, srcpp, n))
+    copy_forward_avx512(dstpp, srcpp, n);
+  else
+    copy_backward_avx512(dstpp, srcpp, n);
+
+  return dstpp;
+}
+
+/*
+ * Fill
+ */
+
+/* Fill n > 32 bytes */
+static NNLC_SSE2 void fill_sse2(char *d, int c, size_t n) {
+  const v16 v = (char)c - (v16){};
+  char *const end = d + n;
+
+  *(unaligned_v16 *)d = v;
+  *(unaligned_v16 *)(end - 16) = v;
+
+  d = (char *)(((uintptr_t)d + 16) & ~(uintptr_t)15);
+  for (; d + 64 < end; d += 64) {
+    *(v16 *)d = v;
+    *(v16 *)(d + 16) = v;
+    *(v16 *)(d + 32) = v;
+    *(v16 *)(d + 48) = v;
+  }
+  for (; d + 16 < end; d += 16) *(v16 *)d = v;
+}
+
+/* Fill n > 64 bytes */
+static NNLC_AVX2 void fill_avx2(char *d, int c, size_t n) {
+  const v32 v = (char)c - (v32){};
+  char *const end = d + n;
+
+  *(unaligned_v32 *)d = v;
+  *(unaligned_v32 *)(end - 32) = v;
+
+  d = (char *)(((uintptr_t)d + 32) & ~(uintptr_t)31);
+  for (; d + 128 < end; d += 128) {
+    *(v32 *)d = v;
+    *(v32 *)(d + 32) = v;
+    *(v32 *)(d + 64) = v;
+    *(v32 *)(d + 96) = v;
+  }
+  for (; d + 32 < end; d += 32) *(v32 *)d = v;
+}
+
+/* Fill n > 128 bytes */
+static NNLC_AVX512 void fill_avx512(char *d, int c, size_t n) {
+  const v64 v = (char)c - (v64){};
+  char *const end = d + n;
+
+  *(unaligned_v64 *)d = v;
+  *(unaligned_v64 *)(end - 64) = v;
+
+  d = (char *)(((uintptr_t)d + 64) & ~(uintptr_t)63);
+  for (; d + 256 < end; d += 256) {
+    *(v64 *)d = v;
+    *(v64 *)(d + 64) = v;
+    *(v64 *)(d + 128) = v;
+    *(v64 *)(d + 192) = v;
+  }
+  for (; d + 64 < end; d += 64) *(v64 *)d = v;
+}
+
+static inline void fill_rep_stosb(char *d, int c, size_t n) {
+  __asm__ volatile("rep stosb" : "+D"(d), "+c"(n) : "a"(c) : "memory");
+}
+
+/* Fill n <= 32 bytes */
+static inline NNLC_SSE2 void fill_small(char *d, int c, size_t n) {
+  if (n <= 16) {
+    const uint64_t v = (uint8_t)c * (uint64_t)0x0101010101010101;
+    if (n >= 8) {
+      *(unaligned_u64 *)d = v;
+      *(unaligned_u64 *)(d + n - 8) = v;
+    } else if (n >= 4) {
+      *(unaligned_u32 *)d = (uint32_t)v;
+      *(unaligned_u32 *)(d + n - 4) = (uint32_t)v;
+    } else if (n > 0) {
+      d[0] = c;
+      d[n / 2] = c;
+      d[n - 1] = c;
+    }
+  } else {
+    const v16 v = (char)c - (v16){};
+    *(unaligned_v16 *)d = v;
+    *(unaligned_v16 *)(d + n - 16) = v;
+  }
+}
+
+static NNLC_SSE2 void *memset_sse2(void *dstpp, int c, size_t n) {
+  if (n <= 32)
+    fill_small(dstpp, c, n);
+  else if (n >= rep_min_size)
+    fill_rep_stosb(dstpp, c, n);
+  else
+    fill_sse2(dstpp, c, n);
+
+  return dstpp;
+}
+
+static NNLC_AVX2 void *memset_avx2(void *dstpp, int c, size_t n) {
+  if (n < NNLC_AVX2_MIN_SIZE)
+    return memset_sse2(dstpp, c, n);
+
+  if (n >= rep_min_size)
+    fill_rep_stosb(dstpp, c, n);
+  else
+    fill_avx2(dstpp, c, n);
+
+  return dstpp;
+}
+
+static NNLC_AVX512 void *memset_avx512(void *dstpp, int c, size_t n) {
+  if (n < NNLC_AVX512_MIN_SIZE)
+    return memset_avx2(dstpp, c, n);
+
+  if (n >= rep_min_size)
+    fill_rep_stosb(dstpp, c, n);
+  else
+    fill_avx512(dstpp, c, n);
+
+  return dstpp;
+}
+
+/*
+ * Compare
+ */
+
+/* Return <0, 0, >0 like memcmp() for n < 16 bytes */
+static inline int compare_small(const unsigned char *a,
+                                const unsigned char *b, size_t n) {
+  uint64_t x, y;
+
+  if (n >= 8) {
+    x = __builtin_bswap64(*(const unaligned_u64 *)a);
+    y = __builtin_bswap64(*(const unaligned_u64 *)b);
+    if (x == y) {
+      x = __builtin_bswap64(*(const unaligned_u64 *)(a + n - 8));
+      y = __builtin_bswap64(*(const unaligned_u64 *)(b + n - 8));
+    }
+  } else if (n >= 4) {
+    x = ((uint64_t)__builtin_bswap32(*(const unaligned_u32 *)a) << 32) |
+        __builtin_bswap32(*(const unaligned_u32 *)(a + n - 4));
+    y = ((uint64_t)__builtin_bswap32(*(const unaligned_u32 *)b) << 32) |
+        __builtin_bswap32(*(const unaligned_u32 *)(b + n - 4));
+  } else {
+    for (; n > 0; --n, ++a, ++b)
+      if (*a != *b) return *a - *b;
+    return 0;
+  }
+
+  return (x > y) - (x < y);
+}
+
+static NNLC_SSE2 int memcmp_sse2(const void *p1, const void *p2, size_t n) {
+  const unsigned char *a = p1, *b = p2;
+  size_t i;
+  unsigned m;
+
+  if (n < 16) return compare_small(a, b, n);
+
+  for (i = 0; i + 16 < n; i += 16) {
+    m = eq_mask16(*(const unaligned_v16 *)(a + i),
+                  *(const unaligned_v16 *)(b + i)) ^ 0xffff;
+    if (m) goto mismatch;
+  }
+
+  /* last vector overlaps the previous ones */
+  i = n - 16;
+  m = eq_mask16(*(const unaligned_v16 *)(a + i),
+                *(const unaligned_v16 *)(b + i)) ^ 0xffff;
+  if (!m) return 0;
+
+mismatch:
+  i += __builtin_ctz(m);
+  return a[i] - b[i];
+}
+
+static NNLC_AVX2 int memcmp_avx2(const void *p1, const void *p2, size_t n) {
+  const unsigned char *a = p1, *b = p2;
+  size_t i;
+  uint32_t m;
+
+  if (n < 32) return memcmp_sse2(a, b, n);
+
+  for (i = 0; i + 32 < n; i += 32) {
+    m = ~eq_mask32(*(const unaligned_v32 *)(a + i),
+                   *(const unaligned_v32 *)(b + i));
+    if (m) goto mismatch;
+  }
+
+  i = n - 32;
+  m = ~eq_mask32(*(const unaligned_v32 *)(a + i),
+                 *(const unaligned_v32 *)(b + i));
+  if (!m) return 0;
+
+mismatch:
+  i += __builtin_ctz(m);
+  return a[i] - b[i];
+}
+
+static NNLC_AVX512 int memcmp_avx512(const void *p1, const void *p2,
+                                     size_t n) {
+  const unsigned char *a = p1, *b = p2;
+  size_t i;
+  uint64_t m;
+
+  if (n < 64) return memcmp_avx2(a, b, n);
+
+  for (i = 0; i + 64 < n; i += 64) {
+    m = ~eq_mask64(*(const unaligned_v64 *)(a + i),
+                   *(const unaligned_v64 *)(b + i));
+    if (m) goto mismatch;
+  }
+
+  i = n - 64;
+  m = ~eq_mask64(*(const unaligned_v64 *)(a + i),
+                 *(const unaligned_v64 *)(b + i));
+  if (!m) return 0;
+
+mismatch:
+  i += __builtin_ctzll(m);
+  return a[i] - b[i];
+}
+
+/* Equality only: differences are OR-ed together, and only checked
+ * every 64 bytes */
+static NNLC_SSE2 int memeq_sse2(const void *p1, const void *p2, size_t n) {
+  const char *a = p1, *b = p2;
+  size_t i;
+  v16 x;
+
+  if (n < 16) {
+    if (n >= 8)
+      return !((*(const unaligned_u64 *)a ^ *(const unaligned_u64 *)b) |
+               (*(const unaligned_u64 *)(a + n - 8) ^
+                *(const unaligned_u64 *)(b + n - 8)));
+    if (n >= 4)
+      return !((*(const unaligned_u32 *)a ^ *(const unaligned_u32 *)b) |
+               (*(const unaligned_u32 *)(a + n - 4) ^
+                *(const unaligned_u32 *)(b + n - 4)));
+    for (; n > 0; --n)
+      if (*a++ != *b++) return 0;
+    return 1;
+  }
+
+  for (i = 0; i + 64 <= n; i += 64) {
+    x = (*(const unaligned_v16 *)(a + i) ^ *(const unaligned_v16 *)(b + i)) |
+        (*(const unaligned_v16 *)(a + i + 16) ^
+         *(const unaligned_v16 *)(b + i + 16)) |
+        (*(const unaligned_v16 *)(a + i + 32) ^
+         *(const unaligned_v16 *)(b + i + 32)) |
+        (*(const unaligned_v16 *)(a + i + 48) ^
+         *(const unaligned_v16 *)(b + i + 48));
+    if (eq_mask16(x, (v16){}) != 0xffff) return 0;
+  }
+
+  /* last vector overlaps the previous ones */
+  x = *(const unaligned_v16 *)(a + n - 16) ^
+      *(const unaligned_v16 *)(b + n - 16);
+  for (; i + 16 < n; i += 16)
+    x |= *(const unaligned_v16 *)(a + i) ^ *(const unaligned_v16 *)(b + i);
+  return eq_mask16(x, (v16){}) == 0xffff;
+}
+
+static NNLC_AVX2 int memeq_avx2(const void *p1, const void *p2, size_t n) {
+  const char *a = p1, *b = p2;
+  size_t i;
+  v32 x;
+
+  if (n < 32) return memeq_sse2(a, b, n);
+
+  for (i = 0; i + 128 <= n; i += 128) {
+    x = (*(const unaligned_v32 *)(a + i) ^ *(const unaligned_v32 *)(b + i)) |
+        (*(const unaligned_v32 *)(a + i + 32) ^
+         *(const unaligned_v32 *)(b + i + 32)) |
+        (*(const unaligned_v32 *)(a + i + 64) ^
+         *(const unaligned_v32 *)(b + i + 64)) |
+        (*(const unaligned_v32 *)(a + i + 96) ^
+         *(const unaligned_v32 *)(b + i + 96));
+    if (eq_mask32(x, (v32){}) != 0xffffffff) return 0;
+  }
+
+  x = *(const unaligned_v32 *)(a + n - 32) ^
+      *(const unaligned_v32 *)(b + n - 32);
+  for (; i + 32 < n; i += 32)
+    x |= *(const unaligned_v32 *)(a + i) ^ *(const unaligned_v32 *)(b + i);
+  return eq_mask32(x, (v32){}) == 0xffffffff;
+}
+
+/* TRUE if a load of size bytes at p may touch the next page. String
+ * compares can't align both strings: they use unaligned loads, except
+ * close to the end of a page where they go one byte at a time. */
+static inline int near_page_end(const void *p, size_t size) {
+  return ((uintptr_t)p & (NNLC_PAGE_SIZE - 1)) > NNLC_PAGE_SIZE - size;
+}
+
+static NNLC_SSE2 int strcmp_sse2(const char *p1, const char *p2) {
+  const unsigned char *a = (const unsigned char *)p1;
+  const unsigned char *b = (const unsigned char *)p2;
+  unsigned m;
+  v16 x;
+
+  for (;;) {
+    if (near_page_end(a, 16) || near_page_end(b, 16)) {
+      if (*a != *b || *a == '\0') return *a - *b;
+      ++a;
+      ++b;
+      continue;
+    }
+
+    /* first different byte, or end of both strings */
+    x = *(const unaligned_v16 *)a;
+    m = (eq_mask16(x, *(const unaligned_v16 *)b) ^ 0xffff) |
+        eq_mask16(x, (v16){});
+    if (m) {
+      m = __builtin_ctz(m);
+      return a[m] - b[m];
+    }
+    a += 16;
+    b += 16;
+  }
+}
+
+static NNLC_AVX2 int strcmp_avx2(const char *p1, const char *p2) {
+  const unsigned char *a = (const unsigned char *)p1;
+  const unsigned char *b = (const unsigned char *)p2;
+  uint32_t m;
+  v32 x;
+
+  for (;;) {
+    if (near_page_end(a, 32) || near_page_end(b, 32)) {
+      if (*a != *b || *a == '\0') return *a - *b;
+      ++a;
+      ++b;
+      continue;
+    }
+
+    x = *(const unaligned_v32 *)a;
+    m = ~eq_mask32(x, *(const unaligned_v32 *)b) | eq_mask32(x, (v32){});
+    if (m) {
+      m = __builtin_ctz(m);
+      return a[m] - b[m];
+    }
+    a += 32;
+    b += 32;
+  }
+}
+
+static NNLC_SSE2 int strncmp_sse2(const char *p1, const char *p2, size_t n) {
+  const unsigned char *a = (const unsigned char *)p1;
+  const unsigned char *b = (const unsigned char *)p2;
+  uint64_t m;
+  v16 x;
+
+  while (n > 0) {
+    if (near_page_end(a, 16) || near_page_end(b, 16)) {
+      if (*a != *b || *a == '\0') return *a - *b;
+      ++a;
+      ++b;
+      --n;
+      continue;
+    }
+
+    x = *(const unaligned_v16 *)a;
+    m = ((eq_mask16(x, *(const unaligned_v16 *)b) ^ 0xffff) |
+         eq_mask16(x, (v16){})) &
+        low_bits(n);
+    if (m) {
+      m = __builtin_ctzll(m);
+      return a[m] - b[m];
+    }
+    if (n <= 16) break;
+    a += 16;
+    b += 16;
+    n -= 16;
+  }
+
+  return 0;
+}
+
+static NNLC_AVX2 int strncmp_avx2(const char *p1, const char *p2, size_t n) {
+  const unsigned char *a = (const unsigned char *)p1;
+  const unsigned char *b = (const unsigned char *)p2;
+  uint64_t m;
+  v32 x;
+
+  while (n > 0) {
+    if (near_page_end(a, 32) || near_page_end(b, 32)) {
+      if (*a != *b || *a == '\0') return *a - *b;
+      ++a;
+      ++b;
+      --n;
+      continue;
+    }
+
+    x = *(const unaligned_v32 *)a;
+    m = (uint32_t)(~eq_mask32(x, *(const unaligned_v32 *)b) |
+                   eq_mask32(x, (v32){})) &
+        low_bits(n);
+    if (m) {
+      m = __builtin_ctzll(m);
+      return a[m] - b[m];
+    }
+    if (n <= 32) break;
+    a += 32;
+    b += 32;
+    n -= 32;
+  }
+
+  return 0;
+}
+
+/*
+ * Search
+ */
+
+static NNLC_SSE2 void *memchr_sse2(const void *spp, int c, size_t n) {
+  const uintptr_t offset = (uintptr_t)spp & 15;
+  const char *p = (const char *)spp - offset;
+  const v16 v = (char)c - (v16){};
+  uint64_t m;
+
+  if (n == 0) return NULL;
+
+  /* first aligned vector, ignoring the bytes before spp */
+  m = eq_mask16(*(const v16 *)p, v) >> offset;
+  if (n <= 16 - offset) {
+    m &= low_bits(n);
+    return m ? (char *)spp + __builtin_ctzll(m) : NULL;
+  }
+  if (m) return (char *)spp + __builtin_ctzll(m);
+  n -= 16 - offset;
+
+  for (p += 16; n > 16; p += 16, n -= 16) {
+    m = eq_mask16(*(const v16 *)p, v);
+    if (m) return (char *)p + __builtin_ctzll(m);
+  }
+
+  m = eq_mask16(*(const v16 *)p, v) & low_bits(n);
+  return m ? (char *)p + __builtin_ctzll(m) : NULL;
+}
+
+static NNLC_AVX2 void *memchr_avx2(const void *spp, int c, size_t n) {
+  const uintptr_t offset = (uintptr_t)spp & 31;
+  const char *p = (const char *)spp - offset;
+  const v32 v = (char)c - (v32){};
+  uint64_t m;
+
+  if (n == 0) return NULL;
+
+  m = eq_mask32(*(const v32 *)p, v) >> offset;
+  if (n <= 32 - offset) {
+    m &= low_bits(n);
+    return m ? (char *)spp + __builtin_ctzll(m) : NULL;
+  }
+  if (m) return (char *)spp + __builtin_ctzll(m);
+  n -= 32 - offset;
+
+  for (p += 32; n > 32; p += 32, n -= 32) {
+    m = eq_mask32(*(const v32 *)p, v);
+    if (m) return (char *)p + __builtin_ctzll(m);
+  }
+
+  m = eq_mask32(*(const v32 *)p, v) & low_bits(n);
+  return m ? (char *)p + __builtin_ctzll(m) : NULL;
+}
+
+static NNLC_AVX512 void *memchr_avx512(const void *spp, int c, size_t n) {
+  const uintptr_t offset = (uintptr_t)spp & 63;
+  const char *p = (const char *)spp - offset;
+  const v64 v = (char)c - (v64){};
+  uint64_t m;
+
+  if (n == 0) return NULL;
+
+  m = eq_mask64(*(const v64 *)p, v) >> offset;
+  if (n <= 64 - offset) {
+    m &= low_bits(n);
+    return m ? (char *)spp + __builtin_ctzll(m) : NULL;
+  }
+  if (m) return (char *)spp + __builtin_ctzll(m);
+  n -= 64 - offset;
+
+  for (p += 64; n > 64; p += 64, n -= 64) {
+    m = eq_mask64(*(const v64 *)p, v);
+    if (m) return (char *)p + __builtin_ctzll(m);
+  }
+
+  m = eq_mask64(*(const v64 *)p, v) & low_bits(n);
+  return m ? (char *)p + __builtin_ctzll(m) : NULL;
+}
+
+static NNLC_SSE2 size_t strlen_sse2(const char *s) {
+  const uintptr_t offset = (uintptr_t)s & 15;
+  const char *p = s - offset;
+  unsigned m = eq_mask16(*(const v16 *)p, (v16){}) >> offset;
+
+  if (m) return __builtin_ctz(m);
+
+  for (p += 16;; p += 16) {
+    m = eq_mask16(*(const v16 *)p, (v16){});
+    if (m) return p + __builtin_ctz(m) - s;
+  }
+}
+
+static NNLC_AVX2 size_t strlen_avx2(const char *s) {
+  const uintptr_t offset = (uintptr_t)s & 31;
+  const char *p = s - offset;
+  uint32_t m = eq_mask32(*(const v32 *)p, (v32){}) >> offset;
+
+  if (m) return __builtin_ctz(m);
+
+  for (p += 32;; p += 32) {
+    m = eq_mask32(*(const v32 *)p, (v32){});
+    if (m) return p + __builtin_ctz(m) - s;
+  }
+}
+
+static NNLC_AVX512 size_t strlen_avx512(const char *s) {
+  const uintptr_t offset = (uintptr_t)s & 63;
+  const char *p = s - offset;
+  uint64_t m = eq_mask64(*(const v64 *)p, (v64){}) >> offset;
+
+  if (m) return __builtin_ctzll(m);
+
+  for (p += 64;; p += 64) {
+    m = eq_mask64(*(const v64 *)p, (v64){});
+    if (m) return p + __builtin_ctzll(m) - s;
+  }
+}
+
+/* strchr() stops on the first byte that is either c or '\0' */
+static NNLC_SSE2 char *strchr_sse2(const char *s, int c) {
+  const uintptr_t offset = (uintptr_t)s & 15;
+  const char *p = s - offset;
+  const v16 v = (char)c - (v16){};
+  v16 x = *(const v16 *)p;
+  unsigned m = (eq_mask16(x, v) | eq_mask16(x, (v16){})) >> offset;
+
+  for (p = s; !m; m = eq_mask16(x, v) | eq_mask16(x, (v16){})) {
+    p = (const char *)((uintptr_t)p & ~(uintptr_t)15) + 16;
+    x = *(const v16 *)p;
+  }
+
+  p += __builtin_ctz(m);
+  return *p == (char)c ? (char *)p : NULL;
+}
+
+static NNLC_AVX2 char *strchr_avx2(const char *s, int c) {
+  const uintptr_t offset = (uintptr_t)s & 31;
+  const char *p = s - offset;
+  const v32 v = (char)c - (v32){};
+  v32 x = *(const v32 *)p;
+  uint32_t m = (eq_mask32(x, v) | eq_mask32(x, (v32){})) >> offset;
+
+  for (p = s; !m; m = eq_mask32(x, v) | eq_mask32(x, (v32){})) {
+    p = (const char *)((uintptr_t)p & ~(uintptr_t)31) + 32;
+    x = *(const v32 *)p;
+  }
+
+  p += __builtin_ctz(m);
+  return *p == (char)c ? (char *)p : NULL;
+}
+
+static NNLC_AVX512 char *strchr_avx512(const char *s, int c) {
+  const uintptr_t offset = (uintptr_t)s & 63;
+  const char *p = s - offset;
+  const v64 v = (char)c - (v64){};
+  v64 x = *(const v64 *)p;
+  uint64_t m = (eq_mask64(x, v) | eq_mask64(x, (v64){})) >> offset;
+
+  for (p = s; !m; m = eq_mask64(x, v) | eq_mask64(x, (v64){})) {
+    p = (const char *)((uintptr_t)p & ~(uintptr_t)63) + 64;
+    x = *(const v64 *)p;
+  }
+
+  p += __builtin_ctzll(m);
+  return *p == (char)c ? (char *)p : NULL;
+}
+
+static NNLC_SSE2 const void *rawmemchr_sse2(const void *spp, int c) {
+  const uintptr_t offset = (uintptr_t)spp & 15;
+  const char *p = (const char *)spp - offset;
+  const v16 v = (char)c - (v16){};
+  unsigned m = eq_mask16(*(const v16 *)p, v) >> offset;
+
+  if (m) return (const char *)spp + __builtin_ctz(m);
+
+  for (p += 16;; p += 16) {
+    m = eq_mask16(*(const v16 *)p, v);
+    if (m) return p + __builtin_ctz(m);
+  }
+}
+
+/* Scanning backwards */
+static NNLC_SSE2 void *memrchr_sse2(const void *spp, int c, size_t n) {
+  const char *const s = spp;
+  const char *const end = s + n;
+  const v16 v = (char)c - (v16){};
+  const char *p;
+  uint64_t m;
+
+  if (n == 0) return NULL;
+
+  /* aligned vector holding the last byte, ignoring the bytes after */
+  p = (const char *)((uintptr_t)(end - 1) & ~(uintptr_t)15);
+  m = eq_mask16(*(const v16 *)p, v) & low_bits(end - p);
+  for (;;) {
+    if (p < s) m &= ~low_bits(s - p);
+    if (m) return (char *)p + 63 - __builtin_clzll(m);
+    if (p <= s) return NULL;
+    p -= 16;
+    m = eq_mask16(*(const v16 *)p, v);
+  }
+}
+
+/* memmem() for short needles: candidates are the positions where both
+ * the first and the last bytes of the needle match, found 16 at a
+ * time. 2 <= nlen <= NNLC_MEMMEM_SHORT, nlen <= hlen. */
+NNLC_SSE2 const char *__nnlc_memmem_short(const char *h, size_t hlen,
+                                          const char *n, size_t nlen) {
+  const v16 first = n[0] - (v16){};
+  const v16 last = n[nlen - 1] - (v16){};
+  const char *const end = h + hlen;
+  unsigned m;
+
+  /* both loads within the haystack */
+  for (; (size_t)(end - h) >= nlen - 1 + 16; h += 16) {
+    m = eq_mask16(*(const unaligned_v16 *)h, first) &
+        eq_mask16(*(const unaligned_v16 *)(h + nlen - 1), last);
+    for (; m; m &= m - 1) {
+      const char *c = h + __builtin_ctz(m);
+      if (!memcmp(c + 1, n + 1, nlen - 2)) return c;
+    }
+  }
+
+  for (; (size_t)(end - h) >= nlen; ++h)
+    if (h[0] == n[0] && h[nlen - 1] == n[nlen - 1] &&
+        !memcmp(h + 1, n + 1, nlen - 2))
+      return h;
+
+  return NULL;
+}
+
+NNLC_SSE42 size_t __nnlc_span_sse42(const char *s, const char *set,
+                                     int reject) {
+  const char *p = s;
+  v16 bytes = {};
+  unsigned i, m;
+  int index;
+
+  for (i = 0; set[i] != '\0'; ++i) {
+    if (i == 16) return (size_t)-1;
+    bytes[i] = set[i];
+  }
+
+  /* one byte at a time until p is aligned: bytes before s may hold a
+   * '\0' that would stop pcmpistri */
+  for (; (uintptr_t)p & 15; ++p) {
+    if (*p == '\0') return p - s;
+    m = eq_mask16(bytes, *p - (v16){}) & low_bits(i);
+    if (reject ? m != 0 : m == 0) return p - s;
+  }
+
+  for (;; p += 16) {
+    const v16 x = *(const v16 *)p;
+    if (reject) {
+      /* first byte in the set; '\0' is not */
+      index = __builtin_ia32_pcmpistri128(bytes, x, 0x00);
+      if (index < 16) return p + index - s;
+      m = eq_mask16(x, (v16){});
+      if (m) return p + __builtin_ctz(m) - s;
+    } else {
+      /* first byte not in the set, including '\0' (negative
+       * polarity) */
+      index = __builtin_ia32_pcmpistri128(bytes, x, 0x10);
+      if (index < 16) return p + index - s;
+    }
+  }
+}
+
+/*
+ * Dispatch
+ */
+
+static struct {
+  void *(*memcpy)(void *, const void *, size_t);
+  void *(*memmove)(void *, const void *, size_t);
+  void *(*memset)(void *, int, size_t);
+  int (*memcmp)(const void *, const void *, size_t);
+  int (*memeq)(const void *, const void *, size_t);
+  int (*strcmp)(const char *, const char *);
+  int (*strncmp)(const char *, const char *, size_t);
+  void *(*memchr)(const void *, int, size_t);
+  size_t (*strlen)(const char *);
+  char *(*strchr)(const char *, int);
+} string_ops = {
+    memcpy_sse2,  memmove_sse2, memset_sse2, memcmp_sse2,
+    memeq_sse2,   strcmp_sse2,  strncmp_sse2, memchr_sse2,
+    strlen_sse2,  strchr_sse2,
+};
+
+void __nnlc_select_string_ops(unsigned cpu_features) {
+  rep_min_size =
+      (cpu_features & NNLC_CPU_ERMS) ? NNLC_REP_MIN_SIZE : (size_t)-1;
+
+  if (cpu_features & NNLC_CPU_AVX512) {
+    string_ops.memcpy = memcpy_avx512;
+    string_ops.memmove = memmove_avx512;
+    string_ops.memset = memset_avx512;
+    string_ops.memcmp = memcmp_avx512;
+    string_ops.memeq = memeq_avx2;
+    string_ops.strcmp = strcmp_avx2;
+    string_ops.strncmp = strncmp_avx2;
+    string_ops.memchr = memchr_avx512;
+    string_ops.strlen = strlen_avx512;
+    string_ops.strchr = strchr_avx512;
+  } else if (cpu_features & NNLC_CPU_AVX2) {
+    string_ops.memcpy = memcpy_avx2;
+    string_ops.memmove = memmove_avx2;
+    string_ops.memset = memset_avx2;
+    string_ops.memcmp = memcmp_avx2;
+    string_ops.memeq = memeq_avx2;
+    string_ops.strcmp = strcmp_avx2;
+    string_ops.strncmp = strncmp_avx2;
+    string_ops.memchr = memchr_avx2;
+    string_ops.strlen = strlen_avx2;
+    string_ops.strchr = strchr_avx2;
+  } else {
+    string_ops.memcpy = memcpy_sse2;
+    string_ops.memmove = memmove_sse2;
+    string_ops.memset = memset_sse2;
+    string_ops.memcmp = memcmp_sse2;
+    string_ops.memeq = memeq_sse2;
+    string_ops.strcmp = strcmp_sse2;
+    string_ops.strncmp = strncmp_sse2;
+    string_ops.memchr = memchr_sse2;
+    string_ops.strlen = strlen_sse2;
+    string_ops.strchr = strchr_sse2;
+  }
+}
+
+void *memcpy(void *dstpp, const void *srcpp, size_t n) {
+  return string_ops.memcpy(dstpp, srcpp, n);
+}
+
+void *memmove(void *dstpp, const void *srcpp, size_t n) {
+  return string_ops.memmove(dstpp, srcpp, n);
+}
+
+void *memset(void *dstpp, int c, size_t n) {
+  return string_ops.memset(dstpp, c, n);
+}
+
+int memcmp(const void *p1, const void *p2, size_t n) {
+  return string_ops.memcmp(p1, p2, n);
+}
+
+int nnlc_memeq(const void *p1, const void *p2, size_t n) {
+  return string_ops.memeq(p1, p2, n);
+}
+
+int strcmp(const char *p1, const char *p2) {
+  return string_ops.strcmp(p1, p2);
+}
+
+int strncmp(const char *p1, const char *p2, size_t n) {
+  return string_ops.strncmp(p1, p2, n);
+}
+
+void *memchr(const void *spp, int c, size_t n) {
+  return string_ops.memchr(spp, c, n);
+}
+
+size_t strlen(const char *s) { return string_ops.strlen(s); }
+
+char *strchr(const char *s, int c) { return string_ops.strchr(s, c); }
+
+const void *rawmemchr(const void *spp, int c) {
+  return rawmemchr_sse2(spp, c);
+}
+
+/* Backwards from the end: no need to look at every match */
+char *strrchr(const char *s, int i) {
+  const size_t len = strlen(s);
+
+  if ((char)i == '\0') return (char *)s + len;
+
+  return memrchr_sse2(s, i, len);
+}
+
+void *memrchr(const void *spp, int c, size_t n) {
+  return memrchr_sse2(spp, c, n);
+}
+
+#endif /* __x86_64__ */
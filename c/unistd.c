@@ -13,10 +13,43 @@
 // limitations under the License.
 
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
+#include "third_party/nanolibc/c/libc_internals.h"
+
+/* Not buffered, but what was printed to the stream before comes first */
 ssize_t write(int fd, const void *buf, size_t count) {
+  FILE *stream;
+
   assert(fd == 1 || fd == 2);
-  return fwrite(buf, sizeof(char), count, fd == 1? stdout : stderr);
+  stream = (fd == 1) ? stdout : stderr;
+  if (fflush(stream)) return -1;
+  return stream->write(buf, count);
+}
+
+/* Not buffered, but what stdin read ahead comes first */
+ssize_t read(int fd, void *buf, size_t count) {
+  const size_t ahead = stdin->in_len - stdin->in_pos;
+  ssize_t got;
+
+  assert(fd == 0);
+  if (ahead > 0) {
+    if (count > ahead) count = ahead;
+    memcpy(buf, stdin->buf + stdin->in_pos, count);
+    stdin->in_pos += count;
+    return count;
+  }
+
+  if (stdin->read == NULL) return 0; /* EOF */
+  if (count == 0) return 0;
+  fflush(stdout);
+  got = stdin->read(buf, count);
+  if (got < 0) {
+    errno = -got;
+    return -1;
+  }
+  return got;
 }
@@ -66,57 +66,6 @@ int raise(int sig) {
   return -1;
 }
 
-FILE *fopen(const char *path, const char *mode) {
-  (void)path; /* silence gcc warning */
-  (void)mode; /* silence gcc warning */
-
-  GGL_WARN_UNSUPPORTED();
-  errno = ENOENT;
-  return NULL;
-}
-
-int fclose(FILE *fp) {
-  (void)fp; /* silence gcc warning */
-
-  GGL_WARN_UNSUPPORTED();
-  errno = EBADF;
-  return -1;
-}
-
-size_t fread(void *ptr, size_t size, size_t nmemb, FILE *stream) {
-  (void)ptr;    /* silence gcc warning */
-  (void)size;   /* silence gcc warning */
-  (void)nmemb;  /* silence gcc warning */
-  (void)stream; /* silence gcc warning */
-
-  GGL_WARN_UNSUPPORTED();
-  return 0;
-}
-
-int fseek(FILE *stream, long offset, int whence) {
-  (void)stream; /* silence gcc warning */
-  (void)offset; /* silence gcc warning */
-  (void)whence; /* silence gcc warning */
-
-  GGL_WARN_UNSUPPORTED();
-  errno = EBADF;
-  return -1;
-}
-
-long ftell(FILE *stream) {
-  (void)stream; /* silence gcc warning */
-
-  GGL_WARN_UNSUPPORTED();
-  errno = EBADF;
-  return -1;
-}
-
-void rewind(FILE *stream) {
-  (void)stream; /* silence gcc warning */
-
-  GGL_WARN_UNSUPPORTED();
-}
-
 int sscanf(const char *str, const char *format, ...) {
   (void)str;    /* silence gcc warning */
   (void)format; /* silence gcc warning */
@@ -151,15 +100,6 @@ double strtod(const char *nptr, char **endptr) {
   return 0;
 }
 
-char *fgets(char *s, int size, FILE *stream) {
-  (void)s;      /* silence gcc warning */
-  (void)size;   /* silence gcc warning */
-  (void)stream; /* silence gcc warning */
-
-  GGL_WARN_UNSUPPORTED();
-  return NULL;
-}
-
 struct tm *localtime(const time_t *timep) {
   (void)timep; /* silence gcc warning */
 
@@ -273,11 +213,3 @@ unsigned int clock(void) {
   GGL_WARN_UNSUPPORTED();
   return 0;
 }
-
-ssize_t read(int fd, void *buf, size_t count) {
-  (void)fd;  /* silence gcc warning */
-  (void)buf;  /* silence gcc warning */
-  (void)count;  /* silence gcc warning */
-  GGL_WARN_UNSUPPORTED();
-  return 0;
-}
@@ -16,8 +16,10 @@
  * Implementation of the EFI runtime wrappers for nanolibC.
  */
 
+#include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <stdlib.h>
 
@@ -37,10 +39,31 @@ extern int main(int argc, char *argv[]);
 static struct {
   struct nnlc_sysdeps nanolibc_sysdeps;
   int main_retval;
+  EFI_FILE_HANDLE root; /* of the volume we were loaded from */
 } private_nnlc_efi_context;
 
 struct nnlc_efi_context __nnlc_efi_context;
 
+/*
+ * Memory
+ */
+
+static void *efi_alloc_pages(size_t npages) {
+  EFI_PHYSICAL_ADDRESS addr;
+  EFI_STATUS Status = uefi_call_wrapper(BS->AllocatePages, 4,
+                                        AllocateAnyPages, EfiLoaderData,
+                                        npages, &addr);
+  if (EFI_ERROR(Status))
+    return NULL;
+
+  return (void *)(uintptr_t)addr;
+}
+
+static void efi_free_pages(void *p, size_t npages) {
+  uefi_call_wrapper(BS->FreePages, 2, (EFI_PHYSICAL_ADDRESS)(uintptr_t)p,
+                    npages);
+}
+
 /*
  * Input/Output
  */
@@ -117,6 +140,190 @@ static ssize_t write_stderr(const void *s8, size_t sz) {
   return sz;
 }
 
+/* nanolibc wrapper to read the keys typed on the EFI console, echoed
+ * to the standard output. Returns at the end of a line like a
+ * terminal, Ctrl-D is the end of the input */
+static ssize_t read_stdin(void *buf, size_t size) {
+  SIMPLE_INPUT_INTERFACE *conin = __nnlc_efi_context.efi_systab->ConIn;
+  char *s8 = buf;
+  size_t n = 0;
+
+  while (n < size) {
+    EFI_INPUT_KEY key;
+    CHAR16 echo[3];
+    UINTN index;
+    EFI_STATUS Status =
+        uefi_call_wrapper(conin->ReadKeyStroke, 2, conin, &key);
+
+    if (Status == EFI_NOT_READY) {
+      if (n > 0) break;
+      uefi_call_wrapper(BS->WaitForEvent, 3, 1, &conin->WaitForKey, &index);
+      continue;
+    }
+    if (EFI_ERROR(Status)) return (n > 0) ? (ssize_t)n : -EIO;
+
+    if (key.UnicodeChar == 4 /* Ctrl-D */) break;
+    if (key.UnicodeChar == 0 || key.UnicodeChar > 0x7f) continue;
+    s8[n] = (key.UnicodeChar == '\r') ? '\n' : (char)key.UnicodeChar;
+    conio_a2u(echo, s8 + n, 1);
+    efi_stdout_writer(echo);
+    if (s8[n++] == '\n') break;
+  }
+
+  return n;
+}
+
+/*
+ * Files, on the volume the image was loaded from. The handles are
+ * EFI_FILE_HANDLEs
+ */
+
+static int efi_errno(EFI_STATUS Status) {
+  switch (Status) {
+    case EFI_NOT_FOUND:
+      return ENOENT;
+    case EFI_ACCESS_DENIED:
+    case EFI_WRITE_PROTECTED:
+      return EACCES;
+    case EFI_VOLUME_FULL:
+      return ENOSPC;
+    case EFI_OUT_OF_RESOURCES:
+      return ENOMEM;
+    default:
+      return EIO;
+  }
+}
+
+/* Opened on first use */
+static EFI_FILE_HANDLE efi_root(void) {
+  EFI_LOADED_IMAGE *image;
+  EFI_STATUS Status;
+
+  if (private_nnlc_efi_context.root != NULL)
+    return private_nnlc_efi_context.root;
+
+  Status = uefi_call_wrapper(BS->HandleProtocol, 3,
+                             __nnlc_efi_context.efi_image,
+                             &LoadedImageProtocol, (void **)&image);
+  if (EFI_ERROR(Status)) return NULL;
+  private_nnlc_efi_context.root = LibOpenRoot(image->DeviceHandle);
+  return private_nnlc_efi_context.root;
+}
+
+static EFI_STATUS efi_truncate(EFI_FILE_HANDLE file) {
+  EFI_FILE_INFO *info = LibFileInfo(file);
+  EFI_STATUS Status;
+
+  if (info == NULL) return EFI_OUT_OF_RESOURCES;
+  info->FileSize = 0;
+  Status = uefi_call_wrapper(file->SetInfo, 4, file, &GenericFileInfo,
+                             (UINTN)info->Size, info);
+  FreePool(info);
+  return Status;
+}
+
+/* ASCII paths, '/' separated. Returns NULL if out of memory */
+static CHAR16 *efi_path(const char *path) {
+  const size_t len = strlen(path);
+  CHAR16 *path16 = malloc((len + 1) * sizeof(*path16));
+  size_t i;
+
+  if (path16 == NULL) return NULL;
+  for (i = 0; i <= len; ++i)
+    path16[i] = (path[i] == '/') ? (CHAR16)'\\' : (CHAR16)path[i];
+  return path16;
+}
+
+static intptr_t efi_file_open(const char *path, int flags) {
+  EFI_FILE_HANDLE root = efi_root(), file;
+  UINT64 mode = EFI_FILE_MODE_READ;
+  EFI_STATUS Status;
+  CHAR16 *path16;
+
+  if (root == NULL) return -ENOENT;
+  path16 = efi_path(path);
+  if (path16 == NULL) return -ENOMEM;
+
+  if (flags & NNLC_FILE_WRITE) mode |= EFI_FILE_MODE_WRITE;
+  Status = uefi_call_wrapper(root->Open, 5, root, &file, path16, mode, 0);
+  if (Status == EFI_NOT_FOUND && (flags & NNLC_FILE_CREATE))
+    Status = uefi_call_wrapper(root->Open, 5, root, &file, path16,
+                               mode | EFI_FILE_MODE_CREATE, 0);
+  else if (!EFI_ERROR(Status) && (flags & NNLC_FILE_TRUNC) &&
+           EFI_ERROR(Status = efi_truncate(file)))
+    uefi_call_wrapper(file->Close, 1, file);
+  free(path16);
+  if (EFI_ERROR(Status)) return -efi_errno(Status);
+
+  return (intptr_t)file;
+}
+
+static int efi_file_remove(const char *path) {
+  EFI_FILE_HANDLE root = efi_root(), file;
+  EFI_STATUS Status;
+  CHAR16 *path16;
+
+  if (root == NULL) return -ENOENT;
+  path16 = efi_path(path);
+  if (path16 == NULL) return -ENOMEM;
+
+  Status = uefi_call_wrapper(root->Open, 5, root, &file, path16,
+                             EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE, 0);
+  free(path16);
+  if (EFI_ERROR(Status)) return -efi_errno(Status);
+
+  /* Delete() closes the file, even when it fails with the
+   * EFI_WARN_DELETE_FAILURE warning */
+  Status = uefi_call_wrapper(file->Delete, 1, file);
+  return (Status == EFI_SUCCESS) ? 0 : -EACCES;
+}
+
+static ssize_t efi_file_read(intptr_t handle, void *buf, size_t size) {
+  EFI_FILE_HANDLE file = (EFI_FILE_HANDLE)handle;
+  UINTN n = size;
+  EFI_STATUS Status = uefi_call_wrapper(file->Read, 3, file, &n, buf);
+
+  return EFI_ERROR(Status) ? -efi_errno(Status) : (ssize_t)n;
+}
+
+static ssize_t efi_file_write(intptr_t handle, const void *buf, size_t size) {
+  EFI_FILE_HANDLE file = (EFI_FILE_HANDLE)handle;
+  UINTN n = size;
+  EFI_STATUS Status =
+      uefi_call_wrapper(file->Write, 3, file, &n, (void *)buf);
+
+  return EFI_ERROR(Status) ? -efi_errno(Status) : (ssize_t)n;
+}
+
+static int64_t efi_file_seek(intptr_t handle, int64_t offset, int whence) {
+  EFI_FILE_HANDLE file = (EFI_FILE_HANDLE)handle;
+  UINT64 pos = 0;
+  EFI_STATUS Status;
+
+  /* EFI only seeks to absolute positions, or to the end with ~0 */
+  if (whence == SEEK_END) {
+    Status = uefi_call_wrapper(file->SetPosition, 2, file, ~(UINT64)0);
+    if (EFI_ERROR(Status)) return -efi_errno(Status);
+  }
+  if (whence != SEEK_SET) {
+    Status = uefi_call_wrapper(file->GetPosition, 2, file, &pos);
+    if (EFI_ERROR(Status)) return -efi_errno(Status);
+    if (offset == 0) return pos;
+  }
+  if ((int64_t)pos + offset < 0) return -EINVAL;
+
+  pos += offset;
+  Status = uefi_call_wrapper(file->SetPosition, 2, file, pos);
+  return EFI_ERROR(Status) ? -efi_errno(Status) : (int64_t)pos;
+}
+
+static int efi_file_close(intptr_t handle) {
+  EFI_FILE_HANDLE file = (EFI_FILE_HANDLE)handle;
+  EFI_STATUS Status = uefi_call_wrapper(file->Close, 1, file);
+
+  return EFI_ERROR(Status) ? -efi_errno(Status) : 0;
+}
+
 /*
  * underlying implementation for exit() wrapper.
  *
@@ -305,6 +512,11 @@ libnanolibc_start(EFI_HANDLE image, EFI_SYSTEM_TABLE *systab) {
   private_nnlc_efi_context.main_retval = EXIT_FAILURE;
   private_nnlc_efi_context.nanolibc_sysdeps.malloc = AllocatePool;
   private_nnlc_efi_context.nanolibc_sysdeps.free = FreePool;
+  /* EFI pages are 4KiB, like NNLC_PAGE_SIZE */
+  private_nnlc_efi_context.nanolibc_sysdeps.alloc_pages = efi_alloc_pages;
+  private_nnlc_efi_context.nanolibc_sysdeps.free_pages = efi_free_pages;
+  /* AllocatePages() does not clear the pages it returns */
+  private_nnlc_efi_context.nanolibc_sysdeps.alloc_pages_zeroed = 0;
 
   /* ConOut may be NULL (eg. b/22847275). In that case,
    * refuse to go any further */
@@ -318,6 +530,25 @@ libnanolibc_start(EFI_HANDLE image, EFI_SYSTEM_TABLE *systab) {
   else
     private_nnlc_efi_context.nanolibc_sysdeps.write_stderr = write_stdout;
 
+  /* no gather write: stdout is buffered anyway */
+  private_nnlc_efi_context.nanolibc_sysdeps.writev_stdout = NULL;
+  private_nnlc_efi_context.nanolibc_sysdeps.writev_stderr = NULL;
+
+  /* ConIn may be NULL too: stdin is then at EOF */
+  private_nnlc_efi_context.nanolibc_sysdeps.read_stdin =
+      __nnlc_efi_context.efi_systab->ConIn ? read_stdin : NULL;
+
+  private_nnlc_efi_context.nanolibc_sysdeps.file_open = efi_file_open;
+  private_nnlc_efi_context.nanolibc_sysdeps.file_read = efi_file_read;
+  private_nnlc_efi_context.nanolibc_sysdeps.file_write = efi_file_write;
+  private_nnlc_efi_context.nanolibc_sysdeps.file_seek = efi_file_seek;
+  private_nnlc_efi_context.nanolibc_sysdeps.file_close = efi_file_close;
+  private_nnlc_efi_context.nanolibc_sysdeps.file_remove = efi_file_remove;
+  /* nnlc_map_file() reads the file into AllocatePages() memory with a
+   * single Read() */
+  private_nnlc_efi_context.nanolibc_sysdeps.map_file = NULL;
+  private_nnlc_efi_context.nanolibc_sysdeps.unmap_file = NULL;
+
   private_nnlc_efi_context.nanolibc_sysdeps.exit = efi_exit;
   private_nnlc_efi_context.nanolibc_sysdeps.usleep = efi_usleep64;
   private_nnlc_efi_context.nanolibc_sysdeps.gettime_monotonic
@@ -332,6 +563,7 @@ libnanolibc_start(EFI_HANDLE image, EFI_SYSTEM_TABLE *systab) {
   if (argc < 0) fprintf(stderr, "Warning: cannot retrieve argc/argv\n");
 
   rc = call_main(argc, argv);
+  _nnlc_finalize();
 
   /* Careful with what we return from efi_main: only
    * success/unsupported allowed! */
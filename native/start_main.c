@@ -30,16 +30,22 @@
  *    actual nanolibc-based code.
  */
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 
 #include "third_party/nanolibc/c/libc.h"
 
 /* These functions are provided by the big .o file of the application,
  * fully linked */
 extern int _NAT2NNL__nnlc_initialize(struct nnlc_sysdeps const *sysdeps);
+extern void _NAT2NNL__nnlc_finalize(void);
 extern int _NAT2NNL_main(int argc, char *argv[]);
 
 /* We need to correctly define all the pointers in this structure
@@ -63,6 +69,16 @@ static uint64_t nnlc_usleep64(uint64_t micro_seconds) {
   return 0;
 }
 
+static void *alloc_pages(size_t npages) {
+  void *p = mmap(NULL, npages * NNLC_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return (p == MAP_FAILED) ? NULL : p;
+}
+
+static void free_pages(void *p, size_t npages) {
+  munmap(p, npages * NNLC_PAGE_SIZE);
+}
+
 /* Wrapper for nanolibC to be able to print something using native eglibc */
 static ssize_t write_stdout(const void *d, size_t sz) {
   return write(STDOUT_FILENO, d, sz);
@@ -72,6 +88,82 @@ static ssize_t write_stderr(const void *d, size_t sz) {
   return write(STDERR_FILENO, d, sz);
 }
 
+static ssize_t read_stdin(void *buf, size_t size) {
+  const ssize_t rv = read(STDIN_FILENO, buf, size);
+  return (rv < 0) ? -errno : rv;
+}
+
+/* struct nnlc_iovec has the layout of struct iovec */
+static ssize_t writev_stdout(const struct nnlc_iovec *iov, int iovcnt) {
+  return writev(STDOUT_FILENO, (const struct iovec *)iov, iovcnt);
+}
+
+static ssize_t writev_stderr(const struct nnlc_iovec *iov, int iovcnt) {
+  return writev(STDERR_FILENO, (const struct iovec *)iov, iovcnt);
+}
+
+/* File system: the handles are file descriptors */
+static intptr_t file_open(const char *path, int flags) {
+  int oflags, fd;
+
+  if ((flags & NNLC_FILE_READ) && (flags & NNLC_FILE_WRITE))
+    oflags = O_RDWR;
+  else if (flags & NNLC_FILE_WRITE)
+    oflags = O_WRONLY;
+  else
+    oflags = O_RDONLY;
+  if (flags & NNLC_FILE_CREATE) oflags |= O_CREAT;
+  if (flags & NNLC_FILE_TRUNC) oflags |= O_TRUNC;
+
+  fd = open(path, oflags | O_CLOEXEC, 0666);
+  return (fd < 0) ? -errno : fd;
+}
+
+static ssize_t file_read(intptr_t fd, void *buf, size_t size) {
+  const ssize_t rv = read(fd, buf, size);
+  return (rv < 0) ? -errno : rv;
+}
+
+static ssize_t file_write(intptr_t fd, const void *buf, size_t size) {
+  const ssize_t rv = write(fd, buf, size);
+  return (rv < 0) ? -errno : rv;
+}
+
+static int64_t file_seek(intptr_t fd, int64_t offset, int whence) {
+  const off_t rv = lseek(fd, offset, whence);
+  return (rv < 0) ? -errno : rv;
+}
+
+static int file_close(intptr_t fd) { return close(fd) ? -errno : 0; }
+
+static int file_remove(const char *path) { return unlink(path) ? -errno : 0; }
+
+static int map_file(const char *path, const void **data, size_t *size) {
+  struct stat st;
+  void *p = NULL;
+  int fd, rv = 0;
+
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return -errno;
+  if (fstat(fd, &st)) {
+    rv = -errno;
+  } else if (st.st_size > 0) { /* mmap() rejects empty mappings */
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) rv = -errno;
+  }
+  close(fd);
+
+  if (rv == 0) {
+    *data = (p != NULL) ? p : (const void *)"";
+    *size = st.st_size;
+  }
+  return rv;
+}
+
+static void unmap_file(const void *data, size_t size) {
+  munmap((void *)data, size);
+}
+
 static int nnlc_gettime(clockid_t clid, uint64_t *secs, uint64_t *nanosecs) {
   struct timespec tp;
   int rv;
@@ -100,8 +192,22 @@ int main(int argc, char *argv[]) {
 
   sd.malloc = malloc;
   sd.free = free;
+  sd.alloc_pages = alloc_pages;
+  sd.free_pages = free_pages;
+  sd.alloc_pages_zeroed = 1; /* anonymous mappings are zero-filled */
   sd.write_stdout = write_stdout;
   sd.write_stderr = write_stderr;
+  sd.writev_stdout = writev_stdout;
+  sd.writev_stderr = writev_stderr;
+  sd.read_stdin = read_stdin;
+  sd.file_open = file_open;
+  sd.file_read = file_read;
+  sd.file_write = file_write;
+  sd.file_seek = file_seek;
+  sd.file_close = file_close;
+  sd.file_remove = file_remove;
+  sd.map_file = map_file;
+  sd.unmap_file = unmap_file;
   sd.exit = exit;
   sd.usleep = nnlc_usleep64;
   sd.gettime_wall = gettime_wall;
@@ -110,7 +216,9 @@ int main(int argc, char *argv[]) {
   rc = _NAT2NNL__nnlc_initialize(&sd);
   if (rc) return rc;
 
-  return _NAT2NNL_main(argc, argv);
+  rc = _NAT2NNL_main(argc, argv);
+  _NAT2NNL__nnlc_finalize();
+  return rc;
 }
 
 #ifdef COVERAGE
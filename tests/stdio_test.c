@@ -17,6 +17,7 @@
 #include <errno.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "third_party/nanolibc/tests/test_utils/nnlc_test.h"
@@ -76,10 +77,157 @@ int main() {
   fputs("fputs() to stderr", stderr);
   putc('\n', stderr);
 
+  {
+    static char buf[64];
+    ASSERT(setvbuf(stdout, buf, 42, sizeof(buf)) != 0);
+    ASSERT(setvbuf(stdout, buf, _IOFBF, sizeof(buf)) == 0);
+    fputs("setvbuf() to ", stdout);
+    puts("stdout");
+    ASSERT(fflush(stdout) == 0);
+    ASSERT(setvbuf(stdout, NULL, _IOLBF, 0) == 0);
+    ASSERT(fflush(NULL) == 0);
+  }
+
 #define FMSG "Test fwrite to stdio\n"
-  fwrite(FMSG, sizeof(FMSG) - 1, 1, stdout);
-  fwrite(FMSG, sizeof(FMSG) - 1, 1, stderr);
+  ASSERT(fwrite(FMSG, sizeof(FMSG) - 1, 1, stdout) == 1);
+  ASSERT(fwrite(FMSG, sizeof(FMSG) - 1, 1, stderr) == 1);
+  ASSERT(fwrite(FMSG, 1, sizeof(FMSG) - 1, stdout) == sizeof(FMSG) - 1);
+  ASSERT(fwrite(FMSG, 1, 0, stdout) == 0);
   ASSERT(NULL != strerror(0));
 
+  {
+    char buf[8] = "xy";
+    FILE *f;
+
+    f = fmemopen(buf, sizeof(buf), "a");
+    ASSERT(f != NULL);
+    ASSERT(fprintf(f, "%d-%s", 4, "z") == 3);
+    ASSERT(fclose(f) == 0);
+    ASSERT(!strcmp(buf, "xy4-z"));
+
+    f = fmemopen(buf, sizeof(buf), "w");
+    ASSERT(f != NULL);
+    fputs("abcdefghijk", f);
+    fclose(f);
+    ASSERT(!memcmp(buf, "abcdefg", 7));
+  }
+
+  {
+    char *mem = NULL;
+    size_t size = 0;
+    int i;
+    FILE *f = open_memstream(&mem, &size);
+
+    ASSERT(f != NULL);
+    fputs("report:\n", f);
+    for (i = 0; i < 10000; ++i) fprintf(f, "%04d\n", i);
+    ASSERT(fwrite("end", 1, 3, f) == 3);
+    ASSERT(fflush(f) == 0);
+    ASSERT(size == 8 + 10000 * 5 + 3);
+    ASSERT(!strncmp(mem, "report:\n0000\n0001\n", 18));
+    ASSERT(!strcmp(mem + size - 8, "9999\nend"));
+    ASSERT(fclose(f) == 0);
+    free(mem);
+  }
+
+  /* files, if the runtime has a file system */
+  {
+    static char big[120000];
+    char line[16];
+    FILE *f = fopen("stdio_test.tmp", "w+");
+
+    if (f != NULL) {
+      int i;
+
+      for (i = 0; i < 20000; ++i) ASSERT(fprintf(f, "%05d\n", i) == 6);
+      ASSERT(ftell(f) == 120000);
+      rewind(f);
+      ASSERT(fgets(line, sizeof(line), f) != NULL);
+      ASSERT(!strcmp(line, "00000\n"));
+      ASSERT(fgetc(f) == '0' && getc(f) == '0');
+      ASSERT(ftell(f) == 8);
+      ASSERT(fread(big, 1, sizeof(big), f) == sizeof(big) - 8);
+      ASSERT(!memcmp(big + sizeof(big) - 14, "19999\n", 6));
+      ASSERT(feof(f) && !ferror(f));
+      ASSERT(fgetc(f) == EOF);
+
+      ASSERT(fseek(f, -6, SEEK_END) == 0);
+      ASSERT(fgets(line, 3, f) != NULL && !strcmp(line, "19"));
+      ASSERT(fputs("xx", f) >= 0);
+      ASSERT(fseek(f, 60000, SEEK_SET) == 0);
+      ASSERT(fread(line, 6, 1, f) == 1 && !memcmp(line, "10000\n", 6));
+      ASSERT(fseek(f, -6, SEEK_CUR) == 0 && ftell(f) == 60000);
+      ASSERT(fclose(f) == 0);
+
+      f = fopen("stdio_test.tmp", "a");
+      ASSERT(f != NULL);
+      ASSERT(fputs("end\n", f) >= 0);
+      ASSERT(fclose(f) == 0);
+
+      f = fopen("stdio_test.tmp", "r");
+      ASSERT(f != NULL);
+      ASSERT(fputc('x', f) == EOF);
+      ASSERT(fseek(f, -16, SEEK_END) == 0);
+      ASSERT(fread(line, 1, sizeof(line), f) == 16);
+      ASSERT(!memcmp(line, "19998\n19xx9\nend\n", 16));
+      ASSERT(fclose(f) == 0);
+
+#ifdef NNLC_MAP_FILE
+      {
+        size_t size = 0;
+        const char *data = nnlc_map_file("stdio_test.tmp", &size);
+
+        ASSERT(data != NULL && size == 120004);
+        ASSERT(!memcmp(data, "00000\n00001\n", 12));
+        ASSERT(!memcmp(data + size - 16, "19998\n19xx9\nend\n", 16));
+        nnlc_unmap_file(data, size);
+      }
+#endif
+
+      f = fopen("stdio_test.tmp", "r");
+      ASSERT(f != NULL);
+      {
+        char *l = NULL;
+        size_t n = 0;
+
+        for (i = 0; getline(&l, &n, f) > 0; ++i) {
+        }
+        ASSERT(i == 20001 && !strcmp(l, "end\n"));
+        rewind(f);
+        ASSERT(getdelim(&l, &n, '1', f) == 11 && !strcmp(l, "00000\n00001"));
+        free(l);
+      }
+      ASSERT(fclose(f) == 0);
+
+      /* reading "a+" files, writing at the end */
+      f = fopen("stdio_test.tmp", "w");
+      ASSERT(f != NULL);
+      ASSERT(fputs("0123456789", f) >= 0);
+      ASSERT(fclose(f) == 0);
+      f = fopen("stdio_test.tmp", "a+");
+      ASSERT(f != NULL);
+      ASSERT(fseek(f, 2, SEEK_SET) == 0);
+      ASSERT(fseek(f, 1, SEEK_CUR) == 0 && ftell(f) == 3);
+      ASSERT(fgetc(f) == '3');
+      ASSERT(fputc('x', f) == 'x');
+      ASSERT(fseek(f, -2, SEEK_END) == 0);
+      ASSERT(fgetc(f) == '9' && fgetc(f) == 'x' && fgetc(f) == EOF);
+      ASSERT(fclose(f) == 0);
+
+      ASSERT(remove("stdio_test.tmp") == 0);
+      ASSERT(fopen("stdio_test.tmp", "r") == NULL);
+      ASSERT(remove("stdio_test.tmp") == -1 && errno == ENOENT);
+    }
+    ASSERT(fopen("stdio_test.does-not-exist", "r") == NULL);
+    ASSERT(errno == ENOENT);
+#ifdef NNLC_MAP_FILE
+    {
+      size_t size;
+      ASSERT(nnlc_map_file("stdio_test.does-not-exist", &size) == NULL);
+      ASSERT(errno == ENOENT);
+    }
+#endif
+  }
+
   return 0;
 }
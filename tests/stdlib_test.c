@@ -14,6 +14,7 @@
 
 /* test stdlib.h/unistd.h */
 
+#include <malloc.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -115,8 +116,229 @@ static void test_malloc_free() {
   printf("Done with malloc/free tests.\n");
 }
 
+/* Many small blocks of all sizes alive at the same time, freed in a
+ * different order than allocated, then allocated again */
+static void test_malloc_small() {
+  static char *ptrs[3000];
+  int i, j;
+
+  for (j = 0; j < 2; ++j) {
+    for (i = 0; i < 3000; ++i) {
+      const int sz = 1 + i % 2100;
+      ptrs[i] = malloc(sz);
+      ASSERT(ptrs[i] != NULL);
+      ASSERT(((intptr_t)ptrs[i] & (ALIGNMENT - 1)) == 0);
+      memset(ptrs[i], i & 0xff, sz);
+    }
+
+    for (i = 0; i < 3000; ++i) {
+      const int sz = 1 + i % 2100;
+      ASSERT((unsigned char)ptrs[i][0] == (i & 0xff));
+      ASSERT((unsigned char)ptrs[i][sz - 1] == (i & 0xff));
+    }
+
+    for (i = 0; i < 3000; i += 2) free(ptrs[i]);
+    for (i = 1; i < 3000; i += 2) free(ptrs[i]);
+  }
+}
+
+static void test_realloc_in_place() {
+  char *p, *q;
+  size_t usable;
+  int i;
+
+  ASSERT(malloc_usable_size(NULL) == 0);
+
+  /* growing up to the usable size never moves the block (but the
+   * debug heap always moves blocks on realloc) */
+  for (i = 1; i < 300000; i = i * 3 + 1) {
+    p = malloc(i);
+    ASSERT(p != NULL);
+    usable = malloc_usable_size(p);
+    ASSERT(usable >= (size_t)i);
+    memset(p, 0x5a, usable);
+    q = realloc(p, usable);
+#ifndef NNLC_DEBUG_HEAP
+    ASSERT(q == p);
+#endif
+    ASSERT(malloc_usable_size(q) == usable);
+    ASSERT(q[usable - 1] == 0x5a);
+    free(q);
+  }
+
+  /* shrinking a large block keeps its content */
+  p = malloc(1024 * 1024);
+  ASSERT(p != NULL);
+  for (i = 0; i < 1024 * 1024; ++i) p[i] = i % 251;
+  p = realloc(p, 300 * 1024 + 1);
+  ASSERT(p != NULL);
+  ASSERT(malloc_usable_size(p) >= 300 * 1024 + 1);
+#ifdef NNLC_MALLOC
+  ASSERT(malloc_usable_size(p) < 1024 * 1024);
+#endif
+  p = realloc(p, 100);
+  ASSERT(p != NULL);
+  ASSERT(malloc_usable_size(p) >= 100);
+#ifdef NNLC_MALLOC
+  ASSERT(malloc_usable_size(p) < 300 * 1024);
+#endif
+  for (i = 0; i < 100; ++i) ASSERT(p[i] == i % 251);
+  free(p);
+}
+
+static void test_memalign() {
+  static const size_t sizes[] = {1, 100, 5000, 300 * 1024};
+  size_t alignment;
+  unsigned i;
+  void *v;
+  char *p;
+
+  for (alignment = sizeof(void *); alignment <= 4 * 1024 * 1024;
+       alignment *= 2) {
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+      p = memalign(alignment, sizes[i]);
+      ASSERT(p != NULL);
+      ASSERT(((intptr_t)p & (alignment - 1)) == 0);
+      memset(p, 0x5a, sizes[i]);
+      p = realloc(p, sizes[i] + 10000);
+      ASSERT(p != NULL);
+      ASSERT(p[sizes[i] - 1] == 0x5a);
+      free(p);
+
+      p = aligned_alloc(alignment, sizes[i]);
+      ASSERT(p != NULL);
+      ASSERT(((intptr_t)p & (alignment - 1)) == 0);
+      ASSERT(malloc_usable_size(p) >= sizes[i]);
+      memset(p, 0x5a, sizes[i]);
+      free(p);
+
+      v = NULL;
+      ASSERT(posix_memalign(&v, alignment, sizes[i]) == 0);
+      ASSERT(v != NULL);
+      ASSERT(((intptr_t)v & (alignment - 1)) == 0);
+      memset(v, 0x5a, sizes[i]);
+      free(v);
+    }
+  }
+
+  ASSERT(posix_memalign(&v, 3 * sizeof(void *), 10) != 0);
+  ASSERT(posix_memalign(&v, 0, 10) != 0);
+
+  p = valloc(10);
+  ASSERT(p != NULL);
+  ASSERT(((intptr_t)p & (4096 - 1)) == 0);
+  free(p);
+}
+
+#ifdef NNLC_MALLOC
+static void test_arena() {
+  struct nnlc_arena *arena, *prev;
+  struct nnlc_arena_mark mark;
+  char *p, *q, *r;
+  int i;
+
+  arena = nnlc_arena_create(4096);
+  ASSERT(arena != NULL);
+
+  p = nnlc_arena_alloc(arena, 10);
+  ASSERT(p != NULL);
+  ASSERT(((intptr_t)p & (ALIGNMENT - 1)) == 0);
+  strcpy(p, "persisted");
+
+  mark = nnlc_arena_get_mark(arena);
+  for (i = 0; i < 1000; ++i) {
+    q = nnlc_arena_alloc(arena, i + 1);
+    ASSERT(q != NULL);
+    ASSERT(((intptr_t)q & (ALIGNMENT - 1)) == 0);
+    memset(q, 0x5a, i + 1);
+  }
+  q = nnlc_arena_alloc(arena, 100000); /* larger than a chunk */
+  ASSERT(q != NULL);
+  memset(q, 0x5a, 100000);
+
+  nnlc_arena_rewind(arena, mark);
+  ASSERT(!strcmp(p, "persisted"));
+  ASSERT(nnlc_arena_alloc(arena, 10) == p + ALIGNMENT);
+
+  /* route malloc through the arena */
+  prev = nnlc_malloc_use_arena(arena);
+  ASSERT(prev == NULL);
+  q = malloc(100);
+  ASSERT(q != NULL);
+  strcpy(q, "from arena");
+  r = strdup(q);
+  ASSERT(!strcmp(r, "from arena"));
+  q = realloc(q, 20000);
+  ASSERT(!strcmp(q, "from arena"));
+  free(q);
+  free(r);
+  ASSERT(nnlc_malloc_use_arena(NULL) == arena);
+
+  q = malloc(100);
+  ASSERT(q != NULL);
+  free(q);
+
+  nnlc_arena_destroy(arena);
+}
+
+static void test_malloc_stats() {
+  struct mallinfo2 before, during;
+  char *p;
+
+  before = mallinfo2();
+  p = malloc(1000);
+  ASSERT(p != NULL);
+  during = mallinfo2();
+  free(p);
+
+  /* all 0 when statistics are not compiled in */
+  if (during.uordblks != 0) {
+    ASSERT(during.uordblks >= before.uordblks + 1000);
+    ASSERT(during.usmblks >= during.uordblks);
+#ifndef NNLC_DEBUG_HEAP /* freed blocks are kept in quarantine */
+    ASSERT(mallinfo2().uordblks == before.uordblks);
+#endif
+  }
+
+  {
+    char *report = NULL;
+    size_t size = 0;
+    FILE *f = open_memstream(&report, &size);
+
+    ASSERT(f != NULL);
+    nnlc_malloc_stats(f);
+    ASSERT(fclose(f) == 0);
+    ASSERT(size > 0 && !strncmp(report, "malloc: ", 8));
+    free(report);
+  }
+}
+
+static void test_malloc_check() {
+  char *p = malloc(10);
+
+  ASSERT(p != NULL);
+  ASSERT(nnlc_malloc_check(NULL) == 0);
+#ifdef NNLC_DEBUG_HEAP
+  {
+    const char before = p[-1], after = p[10];
+
+    p[-1] = 0; /* off by one on both sides */
+    ASSERT(nnlc_malloc_check(NULL) == 1);
+    p[-1] = before;
+    p[10] = 0;
+    ASSERT(nnlc_malloc_check(NULL) == 1);
+    p[10] = after;
+    ASSERT(nnlc_malloc_check(NULL) == 0);
+  }
+#endif
+  free(p);
+}
+#endif
+
 static void test_calloc() {
   char *buf = calloc(3, sizeof(int));
+  char *big;
+  size_t i, j;
   ASSERT(!memcmp(buf, "\x00\x00\x00", 3));
   buf[0] = 1;
   buf[1] = 2;
@@ -131,6 +353,15 @@ static void test_calloc() {
   ASSERT(buf2 == NULL);
 #endif
   free(buf);
+
+  /* large blocks, possibly reusing memory just freed */
+  for (j = 0; j < 3; ++j) {
+    big = calloc(1024 + j, 1024);
+    ASSERT(big != NULL);
+    for (i = 0; i < (1024 + j) * 1024; ++i) ASSERT(big[i] == 0);
+    memset(big, 0x5a, (1024 + j) * 1024);
+    free(big);
+  }
 }
 
 static int timespec_cmp(const struct timespec *a,
@@ -187,6 +418,14 @@ static void test_sleep() {
 
 int main() {
   test_malloc_free();
+  test_malloc_small();
+  test_realloc_in_place();
+  test_memalign();
+#ifdef NNLC_MALLOC
+  test_arena();
+  test_malloc_stats();
+  test_malloc_check();
+#endif
   test_calloc();
   test_sleep();
 
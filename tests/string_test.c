@@ -14,6 +14,8 @@
 
 /* more string.h tests */
 
+#define _GNU_SOURCE /* rawmemchr(), memrchr() in the native flavour */
+
 #include <assert.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -55,6 +57,144 @@ static void test_memops() {
   ASSERT(!strcmp(buf, "4123423450"));
 }
 
+/* All size classes, alignments and overlaps of the mem* functions,
+ * checked byte by byte against what they should do */
+#define MEMOPS_BUF_SIZE 20000
+static void test_memops_sizes() {
+  static const size_t sizes[] = {0,   1,   2,   3,   4,    5,    7,    8,
+                                 9,   15,  16,  17,  31,   32,   33,   63,
+                                 64,  65,  100, 127, 128,  129,  255,  256,
+                                 257, 511, 600, 2047, 2048, 2049, 5000, 16000};
+  static const size_t offsets[] = {0, 1, 3, 8, 15, 16, 31, 32, 33};
+  static char src[MEMOPS_BUF_SIZE], dst[MEMOPS_BUF_SIZE];
+  size_t i, j, k, m, n, d, s;
+
+  for (i = 0; i < sizeof(src); ++i) src[i] = (char)(i * 7 + i / 251);
+
+  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    n = sizes[i];
+    for (j = 0; j < sizeof(offsets) / sizeof(offsets[0]); ++j) {
+      for (k = 0; k < sizeof(offsets) / sizeof(offsets[0]); ++k) {
+        d = offsets[j];
+        s = offsets[k];
+
+        /* nothing written outside [d, d + n) */
+        memset(dst, 'X', n + 64);
+        ASSERT(memcpy(dst + d, src + s, n) == dst + d);
+        ASSERT(!memcmp(dst + d, src + s, n));
+        ASSERT(d == 0 || dst[d - 1] == 'X');
+        ASSERT(dst[d + n] == 'X');
+
+        ASSERT(memset(dst + d, 0xa5, n) == dst + d);
+        for (m = 0; m < n; ++m) ASSERT(dst[d + m] == (char)0xa5);
+        ASSERT(d == 0 || dst[d - 1] == 'X');
+        ASSERT(dst[d + n] == 'X');
+
+        /* overlapping, both directions */
+        memcpy(dst, src, n + 64);
+        ASSERT(memmove(dst + d, dst + s, n) == dst + d);
+        for (m = 0; m < n; ++m) ASSERT(dst[d + m] == src[s + m]);
+        ASSERT(d == 0 || dst[d - 1] == src[d - 1]);
+        ASSERT(dst[d + n] == src[d + n]);
+      }
+    }
+  }
+}
+
+/* strlen, strchr, strrchr, memchr, rawmemchr and memcmp for all
+ * lengths and alignments up to a few vectors */
+static void test_search_sizes() {
+  static char buf[512];
+  static char other[512];
+  size_t off, len, i;
+
+  for (off = 0; off < 64; ++off) {
+    for (len = 0; len < 300; ++len) {
+      char *s = buf + off;
+      memset(buf, 'a', sizeof(buf));
+      for (i = 0; i < len; ++i) s[i] = (char)(0x80 + (i % 64));
+      s[len] = '\0';
+
+      ASSERT(strlen(s) == len);
+      ASSERT(strchr(s, '\0') == s + len);
+      ASSERT(strchr(s, 'a') == NULL);
+      ASSERT(strrchr(s, '\0') == s + len);
+      ASSERT(strrchr(s, 'a') == NULL);
+      ASSERT(rawmemchr(s, '\0') == s + len);
+      ASSERT(memchr(s, 'a', len) == NULL);
+      ASSERT(memchr(s, '\0', len + 1) == s + len);
+      if (len > 0) {
+        ASSERT(strchr(s, s[len - 1]) == s + (len - 1) % 64);
+        ASSERT(memchr(s, s[len - 1], len) == s + (len - 1) % 64);
+        ASSERT(memchr(s, s[len - 1], (len - 1) % 64) == NULL);
+        ASSERT(rawmemchr(s, s[len - 1]) == s + (len - 1) % 64);
+        ASSERT(strrchr(s, s[len - 1]) == s + len - 1);
+        ASSERT(strrchr(s, s[0]) == s + (len - 1) / 64 * 64);
+      }
+
+      memcpy(other, s, len);
+      ASSERT(memcmp(s, other, len) == 0);
+      if (len > 0) {
+        other[len / 2] = 0x7f; /* lower than anything in s */
+        ASSERT(memcmp(s, other, len) > 0);
+        ASSERT(memcmp(other, s, len) < 0);
+        ASSERT(memcmp(s, other, len / 2) == 0);
+      }
+    }
+  }
+}
+
+/* memcmp, nnlc_memeq, strcmp and strncmp: bytes >= 0x80 compare as
+ * unsigned, the first difference wins, crossing pages */
+static void test_compare_sizes() {
+  static char a[3 * 4096], b[3 * 4096];
+  size_t len, diff, off;
+  char *x, *y;
+
+  ASSERT(memcmp("\x80", "\x7f", 1) > 0);
+  ASSERT(memcmp("\x7f", "\x80", 1) < 0);
+  ASSERT(memcmp("abc\xff", "abc\x01", 4) > 0);
+  ASSERT(strcmp("\xff", "a") > 0);
+  ASSERT(strncmp("ab\x80", "ab\x01", 3) > 0);
+  ASSERT(strncmp("ab\x80", "ab\x01", 2) == 0);
+
+  for (len = 1; len < 200; len += (len < 70) ? 1 : 13) {
+    for (off = 0; off < 3 * 4096 - 2 * len; off += 4096 - len / 2 - 1) {
+      x = a + off;
+      y = b + 3 * 4096 - len - 1 - off / 2;
+      memset(x, 'a', len);
+      memset(y, 'a', len);
+      x[len] = y[len] = '\0';
+#ifdef NNLC_MEMEQ
+      ASSERT(nnlc_memeq(x, y, len));
+#endif
+      ASSERT(memcmp(x, y, len) == 0);
+      ASSERT(strcmp(x, y) == 0);
+      ASSERT(strncmp(x, y, len + 10) == 0);
+
+      for (diff = 0; diff < len; diff += 1 + diff / 4) {
+        y[diff] = '\x90';
+#ifdef NNLC_MEMEQ
+        ASSERT(!nnlc_memeq(x, y, len));
+        ASSERT(nnlc_memeq(x, y, diff));
+#endif
+        ASSERT(memcmp(x, y, len) < 0);
+        ASSERT(memcmp(y, x, len) > 0);
+        ASSERT(memcmp(x, y, diff) == 0);
+        ASSERT(strcmp(x, y) < 0);
+        ASSERT(strcmp(y, x) > 0);
+        ASSERT(strncmp(y, x, len) > 0);
+        ASSERT(strncmp(y, x, diff) == 0);
+        y[diff] = 'a';
+      }
+
+      y[len - 1] = '\0';
+      ASSERT(strcmp(x, y) > 0);
+      ASSERT(strncmp(x, y, len - 1) == 0);
+    }
+  }
+}
+
 static void test_strops() {
   static const char psrc[] = "moufmoufblah";
   static char pdest[sizeof(psrc) + 3];
@@ -169,6 +309,157 @@ static void test_strops() {
   ASSERT(strstr(psrc, "fmoub") == NULL);
 }
 
+static void test_strstr() {
+  static char big[3000];
+  static char needle[100];
+  size_t len, i;
+
+  ASSERT(strstr("aaab", "aab") != NULL);
+  ASSERT(!strcmp(strstr("aaab", "aab"), "aab"));
+  ASSERT(!strcmp(strstr("abababc", "ababc"), "ababc"));
+  ASSERT(strstr("abc", "abcd") == NULL);
+  ASSERT(strstr("", "") != NULL);
+  ASSERT(strstr("", "a") == NULL);
+
+  ASSERT(memmem("aaab", 4, "aab", 3) != NULL);
+  ASSERT(memmem("abc", 3, "", 0) != NULL);
+  ASSERT(memmem("abc", 3, "c", 1) != NULL);
+  ASSERT(memmem("a\0b\0c", 5, "b\0c", 3) != NULL);
+  ASSERT(memmem("abc", 2, "bc", 2) == NULL);
+
+  /* periodic haystacks and needles, short and long needles */
+  for (len = 2; len < sizeof(needle); len += 7) {
+    memset(big, 'a', sizeof(big) - 1);
+    memset(needle, 'a', len);
+    needle[len - 1] = 'b';
+    needle[len] = '\0';
+    ASSERT(strstr(big, needle) == NULL);
+    ASSERT(memmem(big, sizeof(big) - 1, needle, len) == NULL);
+    big[2000] = 'b';
+    ASSERT(strstr(big, needle) == big + 2001 - len);
+    ASSERT(memmem(big, sizeof(big) - 1, needle, len) == big + 2001 - len);
+    ASSERT(memmem(big, 2000, needle, len) == NULL);
+
+    for (i = 0; i < sizeof(big) - 1; ++i) big[i] = "ab"[i % 3 == 2];
+    for (i = 0; i < len; ++i) needle[i] = "ab"[(i + 1) % 3 == 2];
+    ASSERT(strstr(big, needle) == big + 1);
+    ASSERT(memmem(big + 3, sizeof(big) - 4, needle, len) == big + 4);
+    needle[len - 1] = 'c';
+    ASSERT(strstr(big, needle) == NULL);
+  }
+}
+
+static void test_strspn() {
+  static const char digits[] = "0123456789";
+  static const char many[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+  static char buf[200];
+  size_t off, len;
+
+  ASSERT(strspn("", "abc") == 0);
+  ASSERT(strspn("abc", "") == 0);
+  ASSERT(strspn("aaab", "a") == 3);
+  ASSERT(strspn("abcabd", "cba") == 5);
+  ASSERT(strcspn("", "abc") == 0);
+  ASSERT(strcspn("abc", "") == 3);
+  ASSERT(strcspn("abc", "c") == 2);
+  ASSERT(strcspn("abc", "xyz") == 3);
+  ASSERT(strcspn("hello, world", " ,") == 5);
+  ASSERT(!strcmp(strpbrk("hello, world", " ,"), ", world"));
+  ASSERT(strpbrk("hello", "xyz") == NULL);
+  ASSERT(strspn("\x80\xff\x80-", "\xff\x80") == 3);
+  ASSERT(strcspn("abc\xff", "\xfe\xff") == 3);
+
+  /* short and long sets, strings crossing a few vectors */
+  for (off = 0; off < 32; ++off) {
+    for (len = 0; len < 100; ++len) {
+      char *s = buf + off;
+      memset(buf, '7', sizeof(buf));
+      s[len] = '\0';
+      ASSERT(strspn(s, digits) == len);
+      ASSERT(strspn(s, many) == len);
+      ASSERT(strcspn(s, "abc,;") == len);
+      ASSERT(strcspn(s, many + 10) == len);
+      s[len] = 'x';
+      s[len + 1] = '\0';
+      ASSERT(strspn(s, digits) == len);
+      ASSERT(strcspn(s, "x,;") == len);
+      ASSERT(strcspn(s, many + 10) == len);
+      ASSERT(strpbrk(s, many + 10) == s + len);
+    }
+  }
+}
+
+static void test_bounded() {
+  static char buf[200], copy[200];
+  char dst[16];
+  char *p;
+  size_t off, len;
+
+  ASSERT(strnlen("", 5) == 0);
+  ASSERT(strnlen("abc", 0) == 0);
+  ASSERT(strnlen("abc", 2) == 2);
+  ASSERT(strnlen("abc", 10) == 3);
+
+  ASSERT(stpcpy(dst, "abc") == dst + 3);
+  ASSERT(!strcmp(dst, "abc"));
+  memset(dst, 'x', sizeof(dst));
+  ASSERT(stpncpy(dst, "abc", 6) == dst + 3);
+  ASSERT(!memcmp(dst, "abc\0\0\0x", 7));
+  ASSERT(stpncpy(dst, "abcdef", 4) == dst + 4);
+  ASSERT(!memcmp(dst, "abcd\0\0x", 7));
+
+  strcpy(dst, "ab");
+  ASSERT(strcat(dst, "cd") == dst);
+  ASSERT(!strcmp(dst, "abcd"));
+  ASSERT(strncat(dst, "efgh", 2) == dst);
+  ASSERT(!strcmp(dst, "abcdef"));
+  ASSERT(!strcmp(strncat(dst, "g", 10), "abcdefg"));
+
+  memset(dst, 'x', sizeof(dst));
+  ASSERT(memccpy(dst, "hello, world", ',', 12) == dst + 6);
+  ASSERT(!memcmp(dst, "hello,x", 7));
+  ASSERT(memccpy(dst, "hello", 'z', 5) == NULL);
+  ASSERT(!memcmp(dst, "hello,x", 7));
+
+#ifdef NNLC_MEMEQ /* strlcpy() and strlcat() are recent in glibc */
+  memset(dst, 'x', sizeof(dst));
+  ASSERT(strlcpy(dst, "hello", 0) == 5);
+  ASSERT(dst[0] == 'x');
+  ASSERT(strlcpy(dst, "hello", 3) == 5);
+  ASSERT(!strcmp(dst, "he"));
+  ASSERT(strlcpy(dst, "hello", sizeof(dst)) == 5);
+  ASSERT(!strcmp(dst, "hello"));
+  ASSERT(strlcat(dst, ", world", 8) == 12);
+  ASSERT(!strcmp(dst, "hello, "));
+  ASSERT(strlcat(dst, "abc", 4) == 7); /* no '\0' in the first 4 bytes */
+  ASSERT(!strcmp(dst, "hello, "));
+  ASSERT(strlcat(dst, "abc", sizeof(dst)) == 10);
+  ASSERT(!strcmp(dst, "hello, abc"));
+#endif
+
+  /* memrchr() and lengths crossing a few vectors */
+  for (off = 0; off < 32; ++off) {
+    for (len = 0; len < 100; ++len) {
+      char *s = buf + off;
+      memset(buf, 'a', sizeof(buf));
+      s[len] = '\0';
+      ASSERT(strnlen(s, len + 50) == len);
+      ASSERT(strnlen(s, len / 2) == len / 2);
+      ASSERT(memrchr(s, 'b', len) == NULL);
+      ASSERT(memrchr(s, 'a', len) == (len ? s + len - 1 : NULL));
+      if (len > 0) {
+        s[0] = 'b';
+        ASSERT(memrchr(s, 'b', len) == s);
+        ASSERT(memrchr(s + 1, 'b', len - 1) == NULL);
+        s[0] = 'a';
+      }
+      p = stpcpy(copy, s);
+      ASSERT(p == copy + len && *p == '\0');
+      ASSERT(!memcmp(copy, s, len));
+    }
+  }
+}
+
 static void check_strtok(char *s, const char *pat, const char *exp_result) {
   char *r = strtok(s, pat);
 
@@ -181,6 +472,8 @@ static void check_strtok(char *s, const char *pat, const char *exp_result) {
 static void test_strtok() {
   char s1[] = "abcdefghi";
   char s2[] = "abcdefghi";
+  char s3[] = ";;key = value;; other=1,2 ;";
+  char *saveptr, *t;
 
   check_strtok(s1, "z", "abcdefghi");
   check_strtok(NULL, "a", NULL);
@@ -188,6 +481,19 @@ static void test_strtok() {
   check_strtok(s2, "d", "abc");
   check_strtok(NULL, "e", "fghi");
   check_strtok(NULL, "i", NULL);
+
+  t = strtok_r(s3, "; =,", &saveptr);
+  ASSERT(t && !strcmp(t, "key"));
+  t = strtok_r(NULL, "; =,", &saveptr);
+  ASSERT(t && !strcmp(t, "value"));
+  t = strtok_r(NULL, "; =,", &saveptr);
+  ASSERT(t && !strcmp(t, "other"));
+  t = strtok_r(NULL, "; =,", &saveptr);
+  ASSERT(t && !strcmp(t, "1"));
+  t = strtok_r(NULL, "; =,", &saveptr);
+  ASSERT(t && !strcmp(t, "2"));
+  ASSERT(strtok_r(NULL, "; =,", &saveptr) == NULL);
+  ASSERT(strtok_r(NULL, "; =,", &saveptr) == NULL);
 }
 
 static void test_memchr() {
@@ -203,7 +509,13 @@ static void test_memchr() {
 
 int main() {
   test_memops();
+  test_memops_sizes();
+  test_search_sizes();
+  test_compare_sizes();
   test_strops();
+  test_strstr();
+  test_strspn();
+  test_bounded();
   test_strtok();
   test_memchr();
 
@@ -14,10 +14,15 @@
 
 /* Test sXprintf() */
 
+#define _GNU_SOURCE /* asprintf() */
+
 #include <string.h>
 #include <assert.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <arpa/inet.h>
 
 #include "third_party/nanolibc/tests/test_utils/nnlc_test.h"
@@ -102,8 +107,105 @@ int main() {
 
   TSXPRINTF("true=1 false=0\n", "true=%d false=%d\n", true, false);
 
-  /* nanolib supports only %a.bx formats, with a == b */
   TSXPRINTF("d1=00d1\n", "d1=%4.4x\n", 0xd1);
+  TSXPRINTF("d1=  d1|d1  |  00d1|", "d1=%4.1x|%-4x|%6.4x|", 0xd1, 0xd1, 0xd1);
+
+  /* all the length modifiers */
+  TSXPRINTF("44 -56 4464 -12 255 65535", "%hhd %hhd %hd %hd %hhu %hu", 300,
+            200, 70000, 65524, -1, -1);
+  TSXPRINTF("-1 18446744073709551615 -1 ffffffffffffffff",
+            "%ld %lu %lld %llx", -1L, -1UL, -1LL, -1ULL);
+  TSXPRINTF("-5 18446744073709551611 -7 7", "%jd %ju %td %tu", (intmax_t)-5,
+            (uintmax_t)-5, (ptrdiff_t)-7, (ptrdiff_t)7);
+  TSXPRINTF("4294967295 2147483647 -2147483648", "%u %d %d", -1, 0x7fffffff,
+            (int)0x80000000);
+
+  /* flags, precision */
+  TSXPRINTF("+42 -42  42 +0", "%+d %+d % d %+i", 42, -42, 42, 0);
+  TSXPRINTF("|0x2a|0X2A|052|0|0|", "|%#x|%#X|%#o|%#o|%#x|", 42, 42, 42, 0, 0);
+  TSXPRINTF("||0|   |", "|%.0d|%#.0o|%3.0x|", 0, 0, 0);
+  TSXPRINTF("|-0042|  -042|-42   |00000042|", "|%05d|%6.3d|%-6d|%#08o|", -42,
+            -42, -42, 042);
+  TSXPRINTF("|   ab|ab   |abc|", "|%5.2s|%-5.2s|%.*s|", "abc", "abc", 9, "abc");
+  TSXPRINTF("|   42|42   |   ab|", "|%*d|%*d|%*.*s|", 5, 42, -5, 42, 5, 2,
+            "abc");
+  TSXPRINTF("|x  |  x|", "|%-3c|%3c|", 'x', 'x');
+
+  /* positional arguments */
+  TSXPRINTF("two 1 two", "%2$s %1$d %2$s", 1, "two");
+  TSXPRINTF("|  0abc|", "|%1$*2$.*3$x|", 0xabc, 6, 4);
+  TSXPRINTF("100% 5 %", "100%% %1$d %%", 5);
+
+  {
+    int n1 = 0, n2 = 0;
+    ASSERT(snprintf(buff, sizeof(buff), "abc%nde%n", &n1, &n2) == 5);
+    ASSERT(n1 == 3 && n2 == 5);
+  }
+
+  /* floating point */
+  TSXPRINTF("1.500000 1.500000e+00 1.5 0x1.8p+0", "%f %e %g %a", 1.5, 1.5,
+            1.5, 1.5);
+  TSXPRINTF("2.001|1.23e+04|1E-10|0x2.0p+0", "%.3f|%.2e|%G|%.1a", 2.0005,
+            12345.678, 1e-10, 1.99);
+  TSXPRINTF("0.2 0.3 2 4", "%.1f %.1f %.0f %.0f", 0.25, 0.35, 2.5, 3.5);
+  TSXPRINTF("100000 1e+06 0.0001 1.00000", "%g %g %g %#g", 100000.0,
+            1000000.0, 0.0001, 1.0);
+  TSXPRINTF("0.10000000000000001 0.10000000000000000555", "%.17g %.20f", 0.1,
+            0.1);
+  TSXPRINTF("4.94066e-324 1.797693e+308 -0x0p+0", "%g %e %a", 5e-324,
+            1.7976931348623157e308, -0.0);
+  TSXPRINTF("-0003.14|4.2e+01  | inf|-INF", "%+08.2f|%-9.1e|% g|%E",
+            -3.14159, 42.0, __builtin_inf(), -__builtin_inf());
+  TSXPRINTF("0.001 0.25", "%.3Lf %.2f", (long double)0.0005, 0.25);
+
+  {
+    char *s = NULL;
+    ASSERT(asprintf(&s, "%s=%llu", "key", 18446744073709551615ULL) == 24);
+    ASSERT(!strcmp(s, "key=18446744073709551615"));
+    free(s);
+    ASSERT(asprintf(&s, "%s", "") == 0);
+    ASSERT(!strcmp(s, ""));
+    free(s);
+    ASSERT(asprintf(&s, "%2000d|", 7) == 2001);
+    ASSERT(strlen(s) == 2001 && s[1999] == '7');
+    free(s);
+  }
+
+#ifdef NNLC_STRBUF
+  {
+    struct nnlc_strbuf sb = NNLC_STRBUF_INIT;
+    const char *buf;
+    int i;
+
+    ASSERT(!strcmp(nnlc_strbuf_str(&sb), ""));
+    ASSERT(nnlc_strbuf_printf(&sb, "record %d", 1) == 8);
+    ASSERT(nnlc_strbuf_append(&sb, ": ", 2) == 0);
+    ASSERT(nnlc_strbuf_printf(&sb, "%.2f", 0.125) == 4);
+    ASSERT(!strcmp(nnlc_strbuf_str(&sb), "record 1: 0.12"));
+    ASSERT(sb.len == 14);
+
+    /* reset keeps the buffer */
+    buf = sb.buf;
+    for (i = 0; i < 100; ++i) {
+      nnlc_strbuf_reset(&sb);
+      ASSERT(nnlc_strbuf_printf(&sb, "record %d", i) > 0);
+    }
+    ASSERT(sb.buf == buf);
+    ASSERT(!strcmp(nnlc_strbuf_str(&sb), "record 99"));
+
+    for (i = 0; i < 1000; ++i) ASSERT(nnlc_strbuf_printf(&sb, "%d,", i) > 0);
+    ASSERT(sb.len == 9 + 10 * 2 + 90 * 3 + 900 * 4);
+    ASSERT(sb.cap > sb.len && !sb.error);
+
+    {
+      char *s = nnlc_strbuf_release(&sb);
+      ASSERT(!strncmp(s, "record 990,1,2,", 15));
+      ASSERT(sb.buf == NULL && sb.len == 0);
+      free(s);
+    }
+    nnlc_strbuf_free(&sb);
+  }
+#endif
 
 #define TINETNTOP(x, y, z, t)                                             \
   ({                                                                      \